@@ -21,6 +21,7 @@
 #include <sstream>
 #include <boost/format.hpp>
 #include <boost/bind.hpp>
+#include <boost/graph/strong_components.hpp>
 #include "hphp/compiler/analysis/alias_manager.h"
 #include "hphp/compiler/analysis/file_scope.h"
 #include "hphp/compiler/analysis/class_scope.h"
@@ -545,6 +546,79 @@ bool AnalysisResult::addConstantDependency(FileScopePtr usingFile,
   return true;
 }
 
+void AnalysisResult::getBuildKeys(const std::string &salt,
+                                  std::vector<MD5> &keys) {
+  keys.clear();
+  keys.reserve(m_fileScopes.size());
+
+  if (Option::WholeProgram || Option::GenerateInferredTypes) {
+    // Inference also flows from users to providers (a callee's parameter
+    // types come from its callers, see FunctionScope::setParamType), and
+    // the emitter bakes the results into every unit. No unit can be reused
+    // unless the whole program is unchanged.
+    std::vector<std::string> parts;
+    BOOST_FOREACH(FileScopePtr fs, m_fileScopes) {
+      parts.push_back(fs->getName() + ':' + fs->getMd5().toString());
+    }
+    sort(parts.begin(), parts.end());
+    string text = salt;
+    BOOST_FOREACH(const string &part, parts) text += part;
+    int len;
+    char *md5str = string_md5(text.data(), text.size(), false, len);
+    keys.assign(m_fileScopes.size(), MD5(string(md5str, len).c_str()));
+    free(md5str);
+    return;
+  }
+
+  std::vector<int> comp(boost::num_vertices(m_depGraph));
+  int ncomp = boost::strong_components(
+    m_depGraph,
+    boost::make_iterator_property_map(
+      comp.begin(), boost::get(boost::vertex_index, m_depGraph)));
+
+  std::vector<std::vector<vertex_descriptor> > members(ncomp);
+  for (vertex_descriptor v = 0; v < comp.size(); v++) {
+    members[comp[v]].push_back(v);
+  }
+
+  // Tarjan's algorithm numbers a component only after every component it
+  // can reach, so the keys of a component's providers are always ready.
+  std::vector<std::string> compKeys(ncomp);
+  for (int c = 0; c < ncomp; c++) {
+    std::vector<std::string> parts;
+    std::vector<std::string> providers;
+    BOOST_FOREACH(vertex_descriptor v, members[c]) {
+      parts.push_back(m_fileVertMap[v]->getMd5().toString());
+      adjacency_iterator it, end;
+      for (boost::tie(it, end) = boost::adjacent_vertices(v, m_depGraph);
+           it != end; ++it) {
+        int d = comp[*it];
+        if (d == c) continue;
+        assert(d < c);
+        providers.push_back(compKeys[d]);
+      }
+    }
+    // Component numbering depends on traversal order, so sort by content to
+    // keep keys stable from one build to the next.
+    sort(parts.begin(), parts.end());
+    sort(providers.begin(), providers.end());
+    providers.erase(unique(providers.begin(), providers.end()),
+                    providers.end());
+
+    string text = salt;
+    BOOST_FOREACH(const string &part, parts) text += part;
+    BOOST_FOREACH(const string &provider, providers) text += provider;
+    int len;
+    char *md5str = string_md5(text.data(), text.size(), false, len);
+    compKeys[c] = string(md5str, len);
+    free(md5str);
+  }
+
+  BOOST_FOREACH(FileScopePtr fs, m_fileScopes) {
+    keys.push_back(MD5(compKeys[comp[fs->vertex()]].c_str()));
+  }
+}
+
 bool AnalysisResult::isConstantDeclared(const std::string &constName) const {
   if (m_constants->isPresent(constName)) return true;
   StringToFileScopePtrMap::const_iterator iter = m_constDecs.find(constName);
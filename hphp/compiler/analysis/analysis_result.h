@@ -24,6 +24,7 @@
 #include "hphp/compiler/analysis/symbol_table.h"
 #include "hphp/compiler/analysis/function_container.h"
 #include "hphp/compiler/package.h"
+#include "hphp/runtime/base/md5.h"
 
 #include "hphp/util/string_bag.h"
 #include "hphp/util/thread_local.h"
@@ -234,6 +235,15 @@ public:
   bool addConstantDependency(FileScopePtr usingFile,
                              const std::string &constantName);
 
+  /**
+   * Compute a key for every file in getAllFilesVector(), in the same order.
+   * A file's key covers its own md5, the md5 of every file it transitively
+   * depends on, and salt, so an unchanged key means the file would be
+   * compiled from exactly the same inputs. With whole-program inference
+   * every file depends on every other one, so all files share one key.
+   */
+  void getBuildKeys(const std::string &salt, std::vector<MD5> &keys);
+
   ClassScopePtr findClass(const std::string &className) const;
   ClassScopePtr findClass(const std::string &className,
                           FindClassBy by);
@@ -7340,10 +7340,79 @@ class EmitterWorker : public JobQueueWorker<FileScopeRawPtr, true, true> {
   bool m_ret;
 };
 
+struct EmitterJobs {
+  JobQueueDispatcher<EmitterWorker::JobType, EmitterWorker>* dispatcher;
+  // Files whose unit from an earlier build is still valid.
+  std::set<const FileScope*> reused;
+};
+
 static void addEmitterWorker(AnalysisResultPtr ar, StatementPtr sp,
                              void *data) {
-  ((JobQueueDispatcher<EmitterWorker::JobType,
-    EmitterWorker>*)data)->enqueue(sp->getFileScope());
+  EmitterJobs* jobs = (EmitterJobs*)data;
+  FileScopeRawPtr fs = sp->getFileScope();
+  if (jobs->reused.count(fs.get())) return;
+  jobs->dispatcher->enqueue(fs);
+}
+
+/**
+ * Record this build's key for every file (see
+ * AnalysisResult::getBuildKeys()).  For an incremental build, also pick
+ * the files whose unit is already in the repo under the same md5 and key,
+ * and remove the units of every other file so they can be emitted again.
+ */
+static void prepareBuildKeys(AnalysisResultPtr ar,
+                             std::set<const FileScope*>& reused) {
+  Repo& repo = Repo::get();
+  int repoId = repo.repoIdForNewUnit(UnitOrigin::File);
+  if (repoId == RepoIdInvalid) return;
+
+  std::ostringstream salt;
+  salt << Option::WholeProgram << Option::PreOptimization
+       << Option::PostOptimization << Option::GenerateInferredTypes
+       << Option::AllVolatile << Option::RepoDebugInfo;
+  std::vector<MD5> keys;
+  ar->getBuildKeys(salt.str(), keys);
+  const std::vector<FileScopePtr>& files = ar->getAllFilesVector();
+
+  std::set<MD5> stale;
+  if (Option::RepoIncremental) {
+    for (size_t i = 0; i < files.size(); i++) {
+      const char* path = files[i]->getName().c_str();
+      const MD5& md5 = files[i]->getMd5();
+      MD5 oldMd5, oldKey, unitMd5;
+      if (repo.getBuildKey(repoId).get(path, oldMd5, oldKey) &&
+          oldMd5 == md5 && oldKey == keys[i] &&
+          repo.getFileHash(repoId).get(path, unitMd5) && unitMd5 == md5) {
+        reused.insert(files[i].get());
+      } else {
+        stale.insert(md5);
+      }
+    }
+    // Files with identical contents share a unit, so none of them can keep
+    // it once one of them needs it emitted again.
+    for (size_t i = 0; i < files.size(); i++) {
+      if (stale.count(files[i]->getMd5())) reused.erase(files[i].get());
+    }
+    Logger::Info("reusing %zu of %zu units from the previous build",
+                 reused.size(), files.size());
+  }
+
+  try {
+    RepoTxn txn(repo);
+    repo.clearBuildKeys(repoId, txn);
+    for (std::set<MD5>::const_iterator it = stale.begin();
+         it != stale.end(); ++it) {
+      repo.removeUnit(repoId, *it, txn);
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+      repo.insertBuildKey(repoId).insert(
+        txn, StringData::GetStaticString(files[i]->getName()),
+        files[i]->getMd5(), keys[i]);
+    }
+    txn.commit();
+  } catch (RepoExc& re) {
+    Logger::Error("Unable to record build keys: %s", re.msg().c_str());
+  }
 }
 
 static void batchCommit(std::vector<UnitEmitter*>& ues) {
@@ -7404,8 +7473,14 @@ void emitAllHHBC(AnalysisResultPtr ar) {
   JobQueueDispatcher<EmitterWorker::JobType, EmitterWorker>
     dispatcher(threadCount, true, 0, false, ar.get());
 
+  EmitterJobs jobs;
+  jobs.dispatcher = &dispatcher;
+  if (Option::GenerateBinaryHHBC) {
+    prepareBuildKeys(ar, jobs.reused);
+  }
+
   dispatcher.start();
-  ar->visitFiles(addEmitterWorker, &dispatcher);
+  ar->visitFiles(addEmitterWorker, &jobs);
 
   if (Option::GenerateBinaryHHBC) {
     // kBatchSize needs to strike a balance between reducing transaction commit
@@ -7438,6 +7513,12 @@ void emitAllHHBC(AnalysisResultPtr ar) {
         break;
       }
     }
+
+    if (Option::RepoIncremental) {
+      Repo& repo = Repo::get();
+      int repoId = repo.repoIdForNewUnit(UnitOrigin::File);
+      if (repoId != RepoIdInvalid) repo.purgeStaleUnits(repoId);
+    }
   } else {
     dispatcher.waitEmpty();
   }
@@ -25,6 +25,7 @@
 
 class TestCodeRun;
 class TestCodeError;
+class TestBuildKeys;
 struct ProgramOptions;
 int process(const ProgramOptions&);
 
@@ -42,6 +43,7 @@ class Type : public JSON::CodeError::ISerializable,
              public JSON::DocTarget::ISerializable {
   friend class ::TestCodeRun;
   friend class ::TestCodeError;
+  friend class ::TestBuildKeys;
 public:
   typedef int KindOf;
 
@@ -49,6 +49,7 @@
 #include <sys/wait.h>
 #include <dlfcn.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/positional_options.hpp>
 #include <boost/program_options/variables_map.hpp>
@@ -96,6 +97,7 @@ struct CompilerOptions {
   bool force;
   int optimizeLevel;
   string filecache;
+  string prevRepo;
   bool dump;
   string docjson;
   bool coredump;
@@ -127,6 +129,44 @@ private:
   const char *m_name;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Times one compiler pass like Timer does, and also records it for the
+ * summary that process() logs once the build is done.
+ */
+class PassTimer {
+public:
+  explicit PassTimer(const char *name)
+      : m_name(name), m_timer(Timer::WallTime, name) {}
+  ~PassTimer() {
+    s_passes.push_back(std::make_pair(m_name, m_timer.getMicroSeconds()));
+  }
+
+  static void Report(int64_t totalUs) {
+    if (s_passes.empty()) return;
+    Logger::Info("pass timing:");
+    int64_t passesUs = 0;
+    for (auto const& pass : s_passes) {
+      passesUs += pass.second;
+      Logger::Info("  %-24s %10.3fs %5.1f%%", pass.first.c_str(),
+                   pass.second / 1000000.0,
+                   totalUs ? pass.second * 100.0 / totalUs : 0.0);
+    }
+    Logger::Info("  %-24s %10.3fs %5.1f%%", "(other)",
+                 (totalUs - passesUs) / 1000000.0,
+                 totalUs ? (totalUs - passesUs) * 100.0 / totalUs : 0.0);
+  }
+
+private:
+  static std::vector<std::pair<std::string, int64_t>> s_passes;
+
+  std::string m_name;
+  Timer m_timer;
+};
+
+std::vector<std::pair<std::string, int64_t>> PassTimer::s_passes;
+
 ///////////////////////////////////////////////////////////////////////////////
 // forward declarations
 
@@ -308,6 +348,11 @@ int prepareOptions(CompilerOptions &po, int argc, char **argv) {
     ("file-cache",
      value<string>(&po.filecache),
      "if specified, generate a static file cache with this file name")
+    ("prev-repo",
+     value<string>(&po.prevRepo),
+     "repo from an earlier hhbc build of the same sources; units of files "
+     "that did not change, and whose dependencies did not change, are "
+     "reused from it instead of being emitted again")
     ("dump",
      value<bool>(&po.dump)->default_value(false),
      "dump the program graph")
@@ -554,7 +599,7 @@ int process(const CompilerOptions &po) {
   }
 
   {
-    Timer timer(Timer::WallTime, "parsing inputs");
+    PassTimer timer("parsing inputs");
     if (!po.inputs.empty() && isPickledPHP) {
       for (unsigned int i = 0; i < po.inputs.size(); i++) {
         package.addSourceFile(po.inputs[i].c_str());
@@ -596,12 +641,15 @@ int process(const CompilerOptions &po) {
       if (!package.parse(!po.force)) {
         return 1;
       }
-      if (Option::WholeProgram || po.target == "analyze") {
-        ar->analyzeProgram();
-      }
     }
   }
 
+  if (po.target != "filecache" &&
+      (Option::WholeProgram || po.target == "analyze")) {
+    PassTimer timer("analyzing program");
+    ar->analyzeProgram();
+  }
+
   // saving file cache
   AsyncFileCacheSaver fileCacheThread(&package, po.filecache.c_str());
   if (po.target != "analyze" && !po.filecache.empty()) {
@@ -665,6 +713,7 @@ int process(const CompilerOptions &po) {
   if (!po.filecache.empty()) {
     fileCacheThread.waitForEnd();
   }
+  PassTimer::Report(timer.getMicroSeconds());
   return ret;
 }
 
@@ -702,24 +751,27 @@ int analyzeTarget(const CompilerOptions &po, AnalysisResultPtr ar) {
     Option::GenerateInferredTypes = true;
   }
   if (Option::PreOptimization) {
-    Timer timer(Timer::WallTime, "pre-optimizing");
+    PassTimer timer("pre-optimizing");
     ar->preOptimize();
   }
 
   if (!Option::AllVolatile) {
-    Timer timer(Timer::WallTime, "analyze includes");
+    PassTimer timer("analyze includes");
     ar->analyzeIncludes();
   }
 
   if (Option::GenerateInferredTypes) {
-    Timer timer(Timer::WallTime, "inferring types");
+    PassTimer timer("inferring types");
     ar->inferTypes();
   }
   if (Option::PostOptimization) {
-    Timer timer(Timer::WallTime, "post-optimizing");
+    PassTimer timer("post-optimizing");
     ar->postOptimize();
   }
-  ar->analyzeProgramFinal();
+  {
+    PassTimer timer("final analysis");
+    ar->analyzeProgramFinal();
+  }
 
   return ret;
 }
@@ -801,6 +853,20 @@ void hhbcTargetInit(const CompilerOptions &po, AnalysisResultPtr ar) {
   if (po.format.find("exe") != string::npos) {
     RuntimeOption::RepoCentralPath += ".hhbc";
   }
+  if (!po.prevRepo.empty() && po.target == "hhbc") {
+    // Build on top of a copy of the previous repo. Other targets (run, the
+    // analysis-only ones) never write the repo they would clobber.
+    if (po.prevRepo != RuntimeOption::RepoCentralPath) {
+      try {
+        boost::filesystem::copy_file(
+          po.prevRepo, RuntimeOption::RepoCentralPath,
+          boost::filesystem::copy_option::overwrite_if_exists);
+      } catch (const boost::filesystem::filesystem_error& e) {
+        Logger::Error("Unable to copy %s: %s", po.prevRepo.c_str(), e.what());
+      }
+    }
+    Option::RepoIncremental = true;
+  }
   RuntimeOption::RepoLocalMode = "--";
   RuntimeOption::RepoDebugInfo = Option::RepoDebugInfo;
   RuntimeOption::RepoJournal = "memory";
@@ -847,8 +913,10 @@ int hhbcTarget(const CompilerOptions &po, AnalysisResultPtr ar,
     ret = analyzeTarget(po, ar);
   }
 
-  Timer timer(Timer::WallTime, type);
-  Compiler::emitAllHHBC(ar);
+  {
+    PassTimer timer(type);
+    Compiler::emitAllHHBC(ar);
+  }
 
   if (!po.syncDir.empty()) {
     if (!po.filecache.empty()) {
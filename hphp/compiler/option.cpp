@@ -83,6 +83,7 @@ bool Option::GenerateTextHHBC = false;
 bool Option::GenerateBinaryHHBC = false;
 string Option::RepoCentralPath;
 bool Option::RepoDebugInfo = false;
+bool Option::RepoIncremental = false;
 
 string Option::IdPrefix = "$$";
 string Option::LabelEscape = "$";
@@ -265,6 +266,7 @@ void Option::Load(Hdf &config) {
       RepoCentralPath = repoCentral["Path"].getString();
     }
     RepoDebugInfo = repo["DebugInfo"].getBool(false);
+    RepoIncremental = repo["Incremental"].getBool(false);
   }
 
   {
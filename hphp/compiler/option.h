@@ -157,6 +157,8 @@ public:
   static bool GenerateBinaryHHBC;
   static std::string RepoCentralPath;
   static bool RepoDebugInfo;
+  // Reuse units already in the output repo when their build key matches.
+  static bool RepoIncremental;
 
   /**
    * Names of hot and cold functions to be marked in sources.
@@ -21,6 +21,7 @@
 #include "hphp/runtime/vm/unit.h"
 #include "hphp/runtime/vm/bytecode.h"
 #include "hphp/runtime/vm/funcdict.h"
+#include "hphp/runtime/vm/repo.h"
 #include "hphp/runtime/vm/runtime.h"
 #include "hphp/runtime/ext_hhvm/ext_hhvm.h"
 #include "hphp/runtime/vm/jit/translator.h"
@@ -99,6 +100,13 @@ void ProcessInit() {
   // ensure that nextTx64 and tx64 are set
   (void)Transl::Translator::Get();
 
+  // Intern the repo's literals while this is the only thread doing so, so
+  // that loading units later finds them instead of growing the table.
+  if (RuntimeOption::RepoAuthoritative &&
+      RuntimeOption::RepoPreloadStaticStrings) {
+    Repo::get().preloadStaticStrings();
+  }
+
   // Save the current options, and set things up so that
   // systemlib.php can be read from and stored in the
   // normal repo.
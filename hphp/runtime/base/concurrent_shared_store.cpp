@@ -20,6 +20,8 @@
 #include "hphp/runtime/ext/ext_apc.h"
 #include "hphp/util/logger.h"
 #include "hphp/util/timer.h"
+#include "folly/ScopeGuard.h"
+#include <algorithm>
 #include <mutex>
 
 using std::set;
@@ -112,6 +114,7 @@ bool ConcurrentTableSharedStore::clear() {
     free((void *)iter->first);
   }
   m_vars.clear();
+  m_bytes = 0;
   return true;
 }
 
@@ -124,8 +127,7 @@ bool ConcurrentTableSharedStore::clear() {
  */
 bool ConcurrentTableSharedStore::eraseImpl(CStrRef key, bool expired) {
   if (key.isNull()) return false;
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   Map::accessor acc;
   if (m_vars.find(acc, key.data())) {
     if (expired && !acc->second.expired()) {
@@ -133,12 +135,13 @@ bool ConcurrentTableSharedStore::eraseImpl(CStrRef key, bool expired) {
     }
     if (acc->second.inMem()) {
       stats_on_delete(key.get(), &acc->second, expired);
+      releaseFootprint(&acc->second);
       g_vmContext->enqueueSharedVar(acc->second.var);
     } else {
       assert(acc->second.inFile());
-      assert(acc->second.expiry == 0);
+      assert(acc->second.expiry == 0 || acc->second.fromSnapshot);
     }
-    if (expired && acc->second.inFile()) {
+    if (expired && acc->second.inFile() && !acc->second.fromSnapshot) {
       // a primed key expired, do not erase the table entry
       acc->second.var = nullptr;
       acc->second.size = 0;
@@ -228,6 +231,7 @@ bool ConcurrentTableSharedStore::handlePromoteObj(CStrRef key,
       int64_t ttl = sval->expiry ? sval->expiry - time(nullptr) : 0;
       stats_on_update(key.get(), sval, converted, ttl);
       sval->var = converted;
+      updateFootprint(key.data(), sval);
       g_vmContext->enqueueSharedVar(sv);
       return true;
     }
@@ -255,6 +259,7 @@ SharedVariant* ConcurrentTableSharedStore::unserialize(CStrRef key,
     v.unserialize(&vu);
     sval->var = new SharedVariant(v, sval->isSerializedObj());
     stats_on_add(key.get(), sval, 0, true, true); // delayed prime
+    updateFootprint(key.data(), sval);
     return sval->var;
   } catch (Exception &e) {
     raise_notice("APC Primed fetch failed: key %s (%s).",
@@ -266,8 +271,7 @@ SharedVariant* ConcurrentTableSharedStore::unserialize(CStrRef key,
 bool ConcurrentTableSharedStore::get(CStrRef key, Variant &value) {
   const StoreValue *sval;
   SharedVariant *svar = nullptr;
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   bool expired = false;
   bool promoteObj = false;
   {
@@ -298,6 +302,7 @@ bool ConcurrentTableSharedStore::get(CStrRef key, Variant &value) {
         if (RuntimeOption::ApcAllowObj && svar->is(KindOfObject)) {
           promoteObj = true;
         }
+        touch(sval);
         value = svar->toLocal();
         stats_on_get(key.get(), svar);
       }
@@ -328,11 +333,26 @@ static int64_t get_int64_value(StoreValue* sval) {
   return v.toInt64();
 }
 
-int64_t ConcurrentTableSharedStore::inc(CStrRef key, int64_t step, bool &found) {
+// inc() and cas() can grow a value too (an int replacing a string, say), so
+// they check the memory limit the same way store() does.
+int64_t ConcurrentTableSharedStore::inc(CStrRef key, int64_t step,
+                                        bool &found) {
+  int64_t ret = incImpl(key, step, found);
+  maybeEvict();
+  return ret;
+}
+
+bool ConcurrentTableSharedStore::cas(CStrRef key, int64_t old, int64_t val) {
+  bool ret = casImpl(key, old, val);
+  maybeEvict();
+  return ret;
+}
+
+int64_t ConcurrentTableSharedStore::incImpl(CStrRef key, int64_t step,
+                                            bool &found) {
   found = false;
   int64_t ret = 0;
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   StoreValue *sval;
   {
     Map::accessor acc;
@@ -343,6 +363,8 @@ int64_t ConcurrentTableSharedStore::inc(CStrRef key, int64_t step, bool &found)
         SharedVariant *svar = construct(Variant(ret));
         g_vmContext->enqueueSharedVar(sval->var);
         sval->var = svar;
+        updateFootprint(key.data(), sval);
+        touch(sval);
         found = true;
         log_apc(std_apc_hit);
       }
@@ -351,10 +373,10 @@ int64_t ConcurrentTableSharedStore::inc(CStrRef key, int64_t step, bool &found)
   return ret;
 }
 
-bool ConcurrentTableSharedStore::cas(CStrRef key, int64_t old, int64_t val) {
+bool ConcurrentTableSharedStore::casImpl(CStrRef key, int64_t old,
+                                         int64_t val) {
   bool success = false;
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   StoreValue *sval;
   {
     Map::accessor acc;
@@ -364,6 +386,8 @@ bool ConcurrentTableSharedStore::cas(CStrRef key, int64_t old, int64_t val) {
         SharedVariant *var = construct(Variant(val));
         g_vmContext->enqueueSharedVar(sval->var);
         sval->var = var;
+        updateFootprint(key.data(), sval);
+        touch(sval);
         success = true;
         log_apc(std_apc_cas);
       }
@@ -374,8 +398,7 @@ bool ConcurrentTableSharedStore::cas(CStrRef key, int64_t old, int64_t val) {
 
 bool ConcurrentTableSharedStore::exists(CStrRef key) {
   const StoreValue *sval;
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   bool expired = false;
   {
     Map::const_accessor acc;
@@ -416,10 +439,17 @@ static int64_t adjust_ttl(int64_t ttl, bool overwritePrime) {
 
 bool ConcurrentTableSharedStore::store(CStrRef key, CVarRef value, int64_t ttl,
                                        bool overwrite /* = true */) {
+  bool ret = storeImpl(key, value, ttl, overwrite);
+  // must be outside m_lock, eviction takes it for writing
+  maybeEvict();
+  return ret;
+}
+
+bool ConcurrentTableSharedStore::storeImpl(CStrRef key, CVarRef value,
+                                           int64_t ttl, bool overwrite) {
   StoreValue *sval;
   SharedVariant* svar = construct(value);
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   const char *kcp = strdup(key.data());
   bool present;
   time_t expiry = 0;
@@ -454,6 +484,8 @@ bool ConcurrentTableSharedStore::store(CStrRef key, CVarRef value, int64_t ttl,
       adjustedTtl = 0;
     }
     sval->set(svar, adjustedTtl);
+    updateFootprint(key.data(), sval);
+    touch(sval);
     expiry = sval->expiry;
     if (!update) {
       stats_on_add(key.get(), sval, adjustedTtl, false, false);
@@ -479,8 +511,7 @@ bool ConcurrentTableSharedStore::store(CStrRef key, CVarRef value, int64_t ttl,
 
 void ConcurrentTableSharedStore::prime
 (const std::vector<SharedStore::KeyValuePair> &vars) {
-  ConditionalReadLock l(m_lock, !RuntimeOption::ApcConcurrentTableLockFree ||
-                                m_lockingFlag);
+  ConditionalReadLock l(m_lock, needLock());
   // we are priming, so we are not checking existence or expiration
   for (unsigned int i = 0; i < vars.size(); i++) {
     const SharedStore::KeyValuePair &item = vars[i];
@@ -489,6 +520,7 @@ void ConcurrentTableSharedStore::prime
     m_vars.insert(acc, copy);
     if (item.inMem()) {
       acc->second.set(item.value, 0);
+      updateFootprint(copy, &acc->second);
     } else {
       acc->second.sAddr = item.sAddr;
       acc->second.sSize = item.sSize;
@@ -543,6 +575,15 @@ bool ConcurrentTableSharedStore::constructPrime(CVarRef v,
 }
 
 void ConcurrentTableSharedStore::primeDone() {
+  primeFileStorageDone();
+  for (set<string>::const_iterator iter =
+         RuntimeOption::ApcCompletionKeys.begin();
+       iter != RuntimeOption::ApcCompletionKeys.end(); ++iter) {
+    primeCompletionKey(*iter);
+  }
+}
+
+void ConcurrentTableSharedStore::primeFileStorageDone() {
   if (s_apc_file_storage.getState() !=
       SharedStoreFileStorage::StorageState::Invalid) {
     s_apc_file_storage.seal();
@@ -555,37 +596,229 @@ void ConcurrentTableSharedStore::primeDone() {
                          time(nullptr) +
                          RuntimeOption::ApcFileStorageAdviseOutPeriod);
   }
+}
 
-  for (set<string>::const_iterator iter =
-         RuntimeOption::ApcCompletionKeys.begin();
-       iter != RuntimeOption::ApcCompletionKeys.end(); ++iter) {
+void ConcurrentTableSharedStore::primeCompletionKey(const std::string& key) {
+  Map::accessor acc;
+  const char *copy = strdup(key.c_str());
+  if (m_vars.insert(acc, copy)) {
+    acc->second.set(this->construct(1), 0);
+    updateFootprint(copy, &acc->second);
+  } else {
+    free((void *)copy);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// snapshots
+
+int64_t ConcurrentTableSharedStore::writeSnapshot(FILE* f, int waitSeconds,
+                                                  int64_t& skipped) {
+  // Same as dump(), iterating needs the whole table locked
+  bool lockFree = RuntimeOption::ApcConcurrentTableLockFree;
+  if (lockFree) {
+    startLocking();
+    WaitForLockFreeOps(waitSeconds);
+  }
+  SCOPE_EXIT { if (lockFree) stopLocking(); };
+  WriteLock l(m_lock);
+  int64_t count = 0;
+  for (Map::iterator iter = m_vars.begin(); iter != m_vars.end(); ++iter) {
+    const char *key = iter->first;
+    const StoreValue *sval = &iter->second;
+    if (sval->expired()) continue;
+    bool ok;
+    if (!sval->inMem()) {
+      // already in the format unserialize() expects
+      ok = WriteSnapshotRecord(f, key, strlen(key), sval->sAddr,
+                               sval->sSize, sval->expiry);
+    } else if (sval->var->is(KindOfObject)) {
+      if (sval->var->isUnserializedObj()) {
+        // Turning it back into an object to serialize it would run
+        // __wakeup() on this thread, so leave it out and report it.
+        ++skipped;
+        continue;
+      }
+      // save the object's serialized form the way constructPrime() does, so
+      // loading doesn't need its class
+      String s = apc_serialize(String(sval->var->getSerializedObj()));
+      ok = WriteSnapshotRecord(f, key, strlen(key), s.data(), -s.size(),
+                               sval->expiry);
+    } else {
+      String s = apc_serialize(sval->var->toLocal());
+      ok = WriteSnapshotRecord(f, key, strlen(key), s.data(), s.size(),
+                               sval->expiry);
+    }
+    if (!ok) return -1;
+    ++count;
+  }
+  return count;
+}
+
+void ConcurrentTableSharedStore::loadSnapshotEntry(const char* key,
+                                                   int keyLen, char* sAddr,
+                                                   int32_t sSize,
+                                                   int64_t expiry) {
+  ConditionalReadLock l(m_lock, needLock());
+  {
     Map::accessor acc;
-    const char *copy = strdup(iter->c_str());
-    if (m_vars.insert(acc, copy)) {
-      acc->second.set(this->construct(1), 0);
+    const char *copy = strndup(key, keyLen);
+    if (!m_vars.insert(acc, copy)) {
+      free((void *)copy);
+      return;
     }
+    acc->second.sAddr = sAddr;
+    acc->second.sSize = sSize;
+    acc->second.expiry = expiry;
+    acc->second.fromSnapshot = true;
   }
+  if (expiry) {
+    addToExpirationQueue(key, expiry);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// memory limit
+
+void ConcurrentTableSharedStore::updateFootprint(const char* key,
+                                                 const StoreValue* sval) {
+  if (!m_capacity) return;
+  int32_t footprint =
+    sval->inMem() ? strlen(key) + 1 + sval->var->getSpaceUsage() : 0;
+  m_bytes.fetch_add(footprint - sval->footprint, std::memory_order_relaxed);
+  sval->footprint = footprint;
+}
+
+void ConcurrentTableSharedStore::releaseFootprint(const StoreValue* sval) {
+  if (sval->footprint) {
+    m_bytes.fetch_sub(sval->footprint, std::memory_order_relaxed);
+    sval->footprint = 0;
+  }
+}
+
+// Evict down to this fraction of the capacity, so that we don't have to
+// sample the table again on the very next store.
+static const int64_t kEvictionHeadroomDivisor = 10;
+// Sample this many times as many entries as we expect to evict.
+static const size_t kEvictionSampleFactor = 4;
+static const size_t kEvictionMinSamples = 64;
+// Each probe reads a random run of about this many buckets, and a round
+// makes at most kEvictionMaxProbes of them, which bounds how long the table
+// is locked however big it is.
+static const size_t kEvictionGrain = 16;
+static const size_t kEvictionMaxProbes = 64;
+
+static string std_apc_evict = "apc.evict";
+
+void ConcurrentTableSharedStore::evict() {
+  if (m_evicting.exchange(true)) {
+    return; // another thread is already evicting
+  }
+  SCOPE_EXIT { m_evicting.store(false); };
+
+  int64_t target = m_capacity - m_capacity / kEvictionHeadroomDivisor;
+  std::vector<std::pair<uint32_t, std::string> > sample;
+  {
+    // Bucket ranges are only stable while nothing inserts or erases.
+    WriteLock l(m_lock);
+    size_t count = m_vars.size();
+    int64_t bytes = m_bytes.load();
+    if (bytes <= target || !count) return;
+
+    int64_t average = std::max<int64_t>(bytes / count, 1);
+    size_t wanted = kEvictionSampleFactor * ((bytes - target) / average + 1);
+    wanted = std::min(count, std::max(wanted, kEvictionMinSamples));
+    size_t probes = std::min(kEvictionMaxProbes, wanted / kEvictionGrain + 1);
+    sample.reserve(probes * kEvictionGrain);
+    for (size_t i = 0; i < probes; i++) {
+      // Halve the table's bucket range, keeping a random side each time,
+      // down to a run of kEvictionGrain buckets.
+      Map::range_type r = m_vars.range(kEvictionGrain);
+      while (r.is_divisible()) {
+        Map::range_type upper(r, tbb::split());
+        if (rand_r(&m_evictSeed) & 1) r = upper;
+      }
+      for (Map::iterator iter = r.begin(); iter != r.end(); ++iter) {
+        if (iter->second.footprint) {
+          sample.push_back(std::make_pair(iter->second.atime,
+                                          std::string(iter->first)));
+        }
+      }
+    }
+  }
+  // Least recently used first. Sampled keys were copied, so evicting them
+  // only needs the usual read lock and per-entry accessors.
+  std::sort(sample.begin(), sample.end());
+
+  ConditionalReadLock l(m_lock, needLock());
+  for (auto& candidate : sample) {
+    if (m_bytes.load(std::memory_order_relaxed) <= target) break;
+    Map::accessor acc;
+    if (!m_vars.find(acc, candidate.second.c_str())) continue;
+    StoreValue *sval = &acc->second;
+    if (!sval->inMem()) continue;
+    m_evictedBytes += sval->footprint;
+    ++m_evictions;
+    StackStringData sd(acc->first);
+    stats_on_delete(&sd, sval, false);
+    releaseFootprint(sval);
+    g_vmContext->enqueueSharedVar(sval->var);
+    log_apc(std_apc_evict);
+    if (sval->inFile() && !sval->fromSnapshot) {
+      // keep the primed copy, it can be unserialized again on demand
+      sval->var = nullptr;
+      sval->size = 0;
+      sval->expiry = 0;
+    } else {
+      eraseAcc(acc);
+    }
+  }
+}
+
+void ConcurrentTableSharedStore::dumpCapacity(std::ostream & out) {
+  out << "entries: " << size() << std::endl;
+  out << "capacity: " << m_capacity << std::endl;
+  out << "bytes: " << getBytes() << std::endl;
+  out << "evictions: " << getEvictions() << std::endl;
+  out << "evicted-bytes: " << getEvictedBytes() << std::endl;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // debugging support
 
+void ConcurrentTableSharedStore::WaitForLockFreeOps(int waitSeconds) {
+  if (waitSeconds <= 0) return;
+  int begin = time(nullptr);
+  Logger::Info("waiting %d seconds for lock-free apc operations",
+               waitSeconds);
+  while (time(nullptr) - begin < waitSeconds) {
+    sleep(1);
+  }
+}
+
 void ConcurrentTableSharedStore::dump(std::ostream & out, bool keyOnly,
                                       int waitSeconds) {
   // Use write lock here to prevent concurrent ops running in parallel from
   // invalidatint the iterator.
   // This functionality is for debugging and should not be called regularly
   if (RuntimeOption::ApcConcurrentTableLockFree) {
-    m_lockingFlag = true;
-    int begin = time(nullptr);
-    Logger::Info("waiting %d seconds before dump", waitSeconds);
-    while (time(nullptr) - begin < waitSeconds) {
-      sleep(1);
-    }
+    startLocking();
+    WaitForLockFreeOps(waitSeconds);
+  }
+  {
+    WriteLock l(m_lock);
+    out << "Total " << m_vars.size() << std::endl;
+  }
+  dumpEntries(out, keyOnly);
+  if (RuntimeOption::ApcConcurrentTableLockFree) {
+    stopLocking();
   }
+}
+
+void ConcurrentTableSharedStore::dumpEntries(std::ostream & out,
+                                             bool keyOnly) {
   WriteLock l(m_lock);
   Logger::Info("dumping apc");
-  out << "Total " << m_vars.size() << std::endl;
   for (Map::iterator iter = m_vars.begin(); iter != m_vars.end(); ++iter) {
     const char *key = iter->first;
     out << key;
@@ -615,9 +848,6 @@ void ConcurrentTableSharedStore::dump(std::ostream & out, bool keyOnly,
     out << std::endl;
   }
   Logger::Info("dumping apc done");
-  if (RuntimeOption::ApcConcurrentTableLockFree) {
-    m_lockingFlag = false;
-  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -37,10 +37,20 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 // ConcurrentThreadSharedStore
 
+/*
+ * When constructed with a non-zero capacity, the store tracks the bytes
+ * used by its keys and in-memory values and, once a store(), inc() or cas()
+ * pushes it over that limit, evicts the least recently used entries out of
+ * a sample of the table until usage is back under the low watermark. A
+ * memory limit forces the table locking on even if
+ * ApcConcurrentTableLockFree is set, since sampling has to walk buckets.
+ */
 class ConcurrentTableSharedStore : public SharedStore {
 public:
-  explicit ConcurrentTableSharedStore(int id)
-    : SharedStore(id), m_lockingFlag(false), m_purgeCounter(0) {}
+  explicit ConcurrentTableSharedStore(int id, int64_t capacity = 0)
+    : SharedStore(id), m_lockingFlag(false), m_purgeCounter(0),
+      m_capacity(capacity), m_bytes(0), m_evicting(false),
+      m_evictSeed(0), m_evictions(0), m_evictedBytes(0) {}
 
   virtual int size() {
     return m_vars.size();
@@ -60,6 +70,34 @@ public:
 
   // debug support
   virtual void dump(std::ostream & out, bool keyOnly, int waitSeconds);
+  virtual void dumpCapacity(std::ostream & out);
+  // dump() without the locking wait and the "Total" line
+  void dumpEntries(std::ostream & out, bool keyOnly);
+
+  int64_t getCapacity() const { return m_capacity; }
+  int64_t getBytes() const { return m_bytes.load(); }
+  int64_t getEvictions() const { return m_evictions.load(); }
+  int64_t getEvictedBytes() const { return m_evictedBytes.load(); }
+
+  /*
+   * Table-wide operations under ApcConcurrentTableLockFree: startLocking()
+   * makes the concurrent ops take the read lock again, and the ones that
+   * started without it are given waitSeconds to finish before the table is
+   * iterated under the write lock.
+   */
+  void startLocking() { m_lockingFlag = true; }
+  void stopLocking() { m_lockingFlag = false; }
+  static void WaitForLockFreeOps(int waitSeconds);
+
+  // priming and snapshot helpers, split out so a sharded store can route them
+  void primeFileStorageDone();
+  void primeCompletionKey(const std::string& key);
+
+protected:
+  virtual int64_t writeSnapshot(FILE* f, int waitSeconds,
+                                int64_t& skipped);
+  virtual void loadSnapshotEntry(const char* key, int keyLen, char* sAddr,
+                                 int32_t sSize, int64_t expiry);
 
 protected:
   virtual SharedVariant* construct(CVarRef v) {
@@ -96,6 +134,11 @@ protected:
   ReadWriteMutex m_lock;
   bool m_lockingFlag; // flag to enable temporary locking
 
+  bool needLock() const {
+    return !RuntimeOption::ApcConcurrentTableLockFree || m_lockingFlag ||
+           m_capacity;
+  }
+
   typedef std::pair<const char*, time_t> ExpirationPair;
   class ExpirationCompare {
   public:
@@ -119,7 +162,36 @@ protected:
 
   bool handleUpdate(CStrRef key, SharedVariant* svar);
   bool handlePromoteObj(CStrRef key, SharedVariant* svar, CVarRef valye);
+
+  // memory limit support
+  void touch(const StoreValue* sval) {
+    if (m_capacity) {
+      uint32_t now = time(nullptr);
+      if (sval->atime != now) sval->atime = now;
+    }
+  }
+  void updateFootprint(const char* key, const StoreValue* sval);
+  void releaseFootprint(const StoreValue* sval);
+  void maybeEvict() {
+    if (m_capacity && m_bytes.load(std::memory_order_relaxed) > m_capacity) {
+      evict();
+    }
+  }
+  void evict();
+
+  const int64_t m_capacity;
+  std::atomic<int64_t> m_bytes;
+  std::atomic<bool> m_evicting;
+  unsigned int m_evictSeed;
+  std::atomic<int64_t> m_evictions;
+  std::atomic<int64_t> m_evictedBytes;
+
 private:
+  friend class ShardedSharedStore;
+
+  bool storeImpl(CStrRef key, CVarRef val, int64_t ttl, bool overwrite);
+  int64_t incImpl(CStrRef key, int64_t step, bool &found);
+  bool casImpl(CStrRef key, int64_t old, int64_t val);
   SharedVariant* unserialize(CStrRef key, const StoreValue* sval);
 };
 
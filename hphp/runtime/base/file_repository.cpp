@@ -16,8 +16,11 @@
 */
 
 #include "hphp/runtime/base/file_repository.h"
+#include "hphp/runtime/base/program_functions.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/base/zend_string.h"
+#include "hphp/util/async_job.h"
+#include "hphp/util/logger.h"
 #include "hphp/util/process.h"
 #include "hphp/util/trace.h"
 #include "hphp/runtime/base/stat_cache.h"
@@ -33,6 +36,8 @@
 
 #include "folly/ScopeGuard.h"
 
+#include <fstream>
+
 using std::endl;
 
 namespace HPHP {
@@ -131,6 +136,94 @@ bool FileRepository::fileDump(const char *filename) {
   return true;
 }
 
+bool FileRepository::saveUnitList(const std::string &filename) {
+  std::string tmp = filename + ".tmp";
+  {
+    std::ofstream out(tmp.c_str());
+    if (out.fail()) return false;
+    for (ParsedFilesMap::const_iterator it =
+         s_files.begin(); it != s_files.end(); it++) {
+      out << it->first->data() << endl;
+    }
+    if (out.fail()) return false;
+  }
+  return rename(tmp.c_str(), filename.c_str()) == 0;
+}
+
+DECLARE_BOOST_TYPES(UnitPrefetchJob);
+class UnitPrefetchJob {
+public:
+  explicit UnitPrefetchJob(const std::string &path) : m_path(path) {}
+  std::string m_path;
+};
+
+class UnitPrefetchWorker {
+public:
+  void onThreadEnter() {
+    hphp_session_init();
+  }
+  void doJob(UnitPrefetchJobPtr job) {
+    try {
+      FileRepository::prefetchUnit(job->m_path);
+    } catch (const std::exception &e) {
+      Logger::Verbose("Unable to prefetch %s: %s", job->m_path.c_str(),
+                      e.what());
+    } catch (...) {
+      Logger::Verbose("Unable to prefetch %s", job->m_path.c_str());
+    }
+  }
+  void onThreadExit() {
+    hphp_context_exit(g_context.getNoCheck(), false);
+    hphp_session_exit();
+  }
+};
+
+/**
+ * Runs in the background: the dispatcher's threads go away once every
+ * unit has been loaded, but the dispatcher holds on to the job list, so
+ * both live until the process exits.
+ */
+class UnitPrefetcher {
+public:
+  UnitPrefetcher(const UnitPrefetchJobPtrVec &jobs, int threads)
+    : m_jobs(jobs)
+    , m_dispatcher(m_jobs, threads) {
+  }
+  void start() { m_dispatcher.start(); }
+
+private:
+  UnitPrefetchJobPtrVec m_jobs;
+  JobDispatcher<UnitPrefetchJob, UnitPrefetchWorker> m_dispatcher;
+};
+
+void FileRepository::prefetchUnits(const std::string &filename,
+                                   int threads) {
+  static UnitPrefetcher *s_prefetcher = nullptr;
+  if (s_prefetcher || threads <= 0) return;
+
+  std::ifstream in(filename.c_str());
+  if (in.fail()) return;
+  UnitPrefetchJobPtrVec jobs;
+  std::string path;
+  while (std::getline(in, path)) {
+    if (!path.empty()) {
+      jobs.push_back(UnitPrefetchJobPtr(new UnitPrefetchJob(path)));
+    }
+  }
+  if (jobs.empty()) return;
+  Logger::Info("Prefetching %d units listed in %s on %d threads",
+               (int)jobs.size(), filename.c_str(), threads);
+  s_prefetcher = new UnitPrefetcher(jobs, threads);
+  s_prefetcher->start();
+}
+
+void FileRepository::prefetchUnit(const std::string &path) {
+  StringData *spath = StringData::GetStaticString(path);
+  struct stat s;
+  if (!findFile(spath, &s)) return;
+  checkoutFile(spath, s);
+}
+
 void FileRepository::onDelete(PhpFile* f) {
   assert(f->getRef() == 0);
   if (md5Enabled()) {
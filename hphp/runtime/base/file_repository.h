@@ -161,6 +161,16 @@ public:
   static PhpFile *checkoutFile(StringData *rname, const struct stat &s);
   static bool findFile(const StringData *path, struct stat *s);
   static bool fileDump(const char *filename);
+
+  /**
+   * Write the path of every loaded file to filename, one per line, for
+   * prefetchUnits() to read back on the next start. prefetchUnits() loads
+   * them on a pool of background threads, so the first requests find
+   * their units already loaded instead of reading them from the repo.
+   */
+  static bool saveUnitList(const std::string &filename);
+  static void prefetchUnits(const std::string &filename, int threads);
+  static void prefetchUnit(const std::string &path);
   static std::string unitMd5(const std::string& fileMd5);
   static void setFileInfo(const StringData *name, const std::string& md5,
                           FileInfo &fileInfo, bool fromRepo = false);
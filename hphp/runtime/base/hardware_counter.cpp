@@ -17,6 +17,19 @@
 
 #include "hphp/runtime/base/hardware_counter.h"
 
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+const char* const kRequestHWEventNames[NumRequestHWEvents] = {
+  "instructions",
+  "cycles",
+  "llc-misses",
+  "branch-misses",
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
 #ifndef NO_HARDWARE_COUNTERS
 
 #include "hphp/util/logger.h"
@@ -171,6 +184,7 @@ public:
 
 HardwareCounter::HardwareCounter()
   : m_countersSet(false), m_pseudoEvents(false) {
+  initRequestCounters();
   m_instructionCounter = new InstructionCounter();
   if (RuntimeOption::EvalProfileHWEvents == "") {
     m_loadCounter = new LoadCounter();
@@ -191,6 +205,9 @@ HardwareCounter::~HardwareCounter() {
     delete m_counters[i];
   }
   m_counters.clear();
+  for (int i = 0; i < NumRequestHWEvents; i++) {
+    delete m_requestCounters[i];
+  }
 }
 
 void HardwareCounter::Reset(void) {
@@ -307,6 +324,35 @@ static void checkLLCHack(char* event, uint32_t& type, uint64_t& config) {
   }
 }
 
+void HardwareCounter::initRequestCounters() {
+  memset(m_requestCounters, 0, sizeof(m_requestCounters));
+  if (!RuntimeOption::EnableHWCounterStats) return;
+
+  char llcEvent[] = "LLC-load-misses";
+  uint32_t llcType = PERF_TYPE_HW_CACHE;
+  uint64_t llcConfig = PERF_COUNT_HW_CACHE_LL |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  checkLLCHack(llcEvent, llcType, llcConfig);
+
+  m_requestCounters[RequestHWInstructions] =
+    new HardwareCounterImpl(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  m_requestCounters[RequestHWCycles] =
+    new HardwareCounterImpl(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  m_requestCounters[RequestHWLLCMisses] =
+    new HardwareCounterImpl(llcType, llcConfig);
+  m_requestCounters[RequestHWBranchMisses] =
+    new HardwareCounterImpl(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  for (int i = 0; i < NumRequestHWEvents; i++) {
+    if (m_requestCounters[i]->m_err) {
+      Logger::Warning("failed to set request perf event: %s",
+                      kRequestHWEventNames[i]);
+      delete m_requestCounters[i];
+      m_requestCounters[i] = nullptr;
+    }
+  }
+}
+
 bool HardwareCounter::addPerfEvent(char *event) {
   uint32_t type = 0;
   uint64_t config = 0;
@@ -393,6 +439,17 @@ void HardwareCounter::ClearPerfEvents() {
   s_counter->clearPerfEvents();
 }
 
+void HardwareCounter::getRequestCounts(int64_t counts[NumRequestHWEvents]) {
+  // These are never reset; callers only look at differences.
+  for (int i = 0; i < NumRequestHWEvents; i++) {
+    counts[i] = m_requestCounters[i] ? m_requestCounters[i]->read() : 0;
+  }
+}
+
+void HardwareCounter::GetRequestCounts(int64_t counts[NumRequestHWEvents]) {
+  s_counter->getRequestCounts(counts);
+}
+
 const StaticString
   s_instructions("instructions"),
   s_loads("loads"),
@@ -24,6 +24,20 @@
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+/*
+ * Events counted for every request when Stats.HardwareCounters is on. They
+ * are kept apart from the events PHP code sets up, so neither disturbs the
+ * other.
+ */
+enum RequestHWEvent {
+  RequestHWInstructions,
+  RequestHWCycles,
+  RequestHWLLCMisses,
+  RequestHWBranchMisses,
+  NumRequestHWEvents
+};
+extern const char* const kRequestHWEventNames[NumRequestHWEvents];
+
 #ifndef NO_HARDWARE_COUNTERS
 
 class InstructionCounter;
@@ -50,6 +64,7 @@ public:
   static bool SetPerfEvents(CStrRef events);
   static void GetPerfEvents(Array& ret);
   static void ClearPerfEvents();
+  static void GetRequestCounts(int64_t counts[NumRequestHWEvents]);
 
   void  reset(void);
   int64_t getInstructionCount(void);
@@ -60,6 +75,7 @@ public:
   bool setPerfEvents(CStrRef events);
   void getPerfEvents(Array& ret);
   void clearPerfEvents();
+  void getRequestCounts(int64_t counts[NumRequestHWEvents]);
 
   static DECLARE_THREAD_LOCAL_NO_CHECK(HardwareCounter, s_counter);
   bool m_countersSet;
@@ -68,7 +84,10 @@ private:
   LoadCounter *m_loadCounter;
   StoreCounter *m_storeCounter;
   std::vector<HardwareCounterImpl *> m_counters;
+  HardwareCounterImpl *m_requestCounters[NumRequestHWEvents];
   bool m_pseudoEvents;
+
+  void initRequestCounters();
 };
 
 #else // NO_HARDWARE_COUNTERS
@@ -97,6 +116,8 @@ public:
          { s_counter.getPerfEvents(ret); }
   static void ClearPerfEvents()
          { s_counter.clearPerfEvents(); }
+  static void GetRequestCounts(int64_t counts[NumRequestHWEvents])
+         { s_counter.getRequestCounts(counts); }
 
   void  reset(void) { }
   int64_t getInstructionCount(void)
@@ -113,6 +134,8 @@ public:
         { return false; }
   void  getPerfEvents(Array& ret) { }
   void  clearPerfEvents() { }
+  void  getRequestCounts(int64_t counts[NumRequestHWEvents])
+        { memset(counts, 0, sizeof(int64_t) * NumRequestHWEvents); }
 
   // Normally exposed by DECLARE_THREAD_LOCAL_NO_CHECK
   void getCheck() { }
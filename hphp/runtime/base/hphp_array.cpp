@@ -115,7 +115,7 @@ HphpArray::HphpArray(uint capacity)
   assert(m_size == 0);
   const auto mask = computeMaskFromNumElms(capacity);
   m_tableMask = mask;
-  allocData(computeMaxElms(mask), computeTableSize(mask));
+  allocData(computeMaxElms(mask), 0);
   assert(checkInvariants());
 }
 
@@ -129,7 +129,7 @@ HphpArray::HphpArray(uint size, const TypedValue* values)
 #endif
   const auto mask = computeMaskFromNumElms(size);
   m_tableMask = mask;
-  allocData(computeMaxElms(mask), computeTableSize(mask));
+  allocData(computeMaxElms(mask), 0);
   // append values by moving -- Caller assumes we update refcount.  Values
   // are in reverse order since they come from the stack, which grows down.
   Elm* data = m_data;
@@ -159,7 +159,7 @@ HphpArray::HphpArray(const HphpArray& other, AllocationMode mode, CopyVector)
     , m_tableMask(other.m_tableMask) {
   assert(other.isVector());
   m_pos = other.m_pos;
-  allocData(other.m_cap, computeTableSize(m_tableMask));
+  allocData(other.m_cap, 0);
   // Copy the elements and bump up refcounts as needed.
   Elm* elms = other.m_data;
   Elm* targetElms = m_data;
@@ -256,10 +256,11 @@ HphpArray* HphpArray::vectorToGeneric() {
   if (m_data == m_inline_data.slots) {
     m_hash = m_inline_data.hash;
   } else {
-    auto dataSize = m_cap * sizeof(*m_data);
-    auto hashSize = computeTableSize(m_tableMask) * sizeof(*m_hash);
-    m_hash = hashSize <= sizeof(m_inline_hash) ? m_inline_hash :
-             (ElmInd*)(uintptr_t(m_data) + dataSize);
+    // Vectors only allocate their slots; make room for the hash table now
+    // unless it fits in the unused inline space.
+    auto tableSize = computeTableSize(m_tableMask);
+    m_hash = tableSize * sizeof(*m_hash) <= sizeof(m_inline_hash) ?
+             m_inline_hash : reallocData(m_cap, tableSize);
   }
   m_kind = kMixedKind;
   uint32_t i = 0;
@@ -296,7 +297,7 @@ HphpArray* HphpArray::vectorToGeneric() {
 //   m_size == m_used
 //   m_nextKI = uninitialized
 //   m_hLoad = uninitialized
-//   m_hash = uninitialized
+//   m_hash = uninitialized; no hash table space is allocated
 //   Elm.key uninitialized
 //   Elm.hash uninitialized
 //   no KindOfInvalid tombstones
@@ -800,7 +801,7 @@ void HphpArray::growVec() {
   auto maxElms = m_cap * 2;
   auto mask = m_tableMask * 2 + 1;
   m_tableMask = mask;
-  reallocData(maxElms, computeTableSize(mask));
+  reallocData(maxElms, 0);
 }
 
 void HphpArray::compact(bool renumber /* = false */) {
@@ -1680,7 +1681,10 @@ ArrayData* HphpArray::Dequeue(ArrayData* ad, Variant& value) {
         tvRefcountedDecRef(&e->data);
         return a;
       }
+      // Escalation may move the slots to make room for the hash table.
       a->vectorToGeneric();
+      elms = a->m_data;
+      e = &elms[pos];
     }
     a->erase(e->hasStrKey() ?
              a->findForInsert(e->key, e->hash()) :
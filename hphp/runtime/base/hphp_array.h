@@ -232,6 +232,16 @@ public:
    */
   static ArrayData* AddNewElemC(ArrayData* a, TypedValue value);
 
+  /**
+   * Inline fast paths for the translator's int-keyed ArrayGet and ArraySet
+   * helpers.  They only handle in-bounds keys on a vector-kind array (and,
+   * for the set, an unshared one), so no ArrayData dispatch or escalation is
+   * needed.  NvGetIntVecFast returns nullptr and SetIntVecFast returns false
+   * whenever the caller must take the generic path.
+   */
+  static TypedValue* NvGetIntVecFast(const ArrayData* ad, int64_t k);
+  static bool SetIntVecFast(ArrayData* ad, int64_t k, const Cell& v);
+
 private:
   template <typename AccessorT>
   SortFlavor preSort(const AccessorT& acc, bool checkTypes);
@@ -364,6 +374,9 @@ private:
   //            +--------------------+
   // m_hash --> |                    | 2^K hash table entries.
   //            +--------------------+
+  //
+  // Vector-kind arrays never consult the hash table, so they allocate only
+  // the slots; vectorToGeneric() adds the hash table space on escalation.
 
   uint32_t m_used;       // Number of used elements (values or tombstones)
   uint32_t m_cap;        // Number of Elms we can use before having to grow.
@@ -526,6 +539,27 @@ inline void HphpArray::release() {
   ArrayData::release();
 }
 
+inline TypedValue* HphpArray::NvGetIntVecFast(const ArrayData* ad,
+                                              int64_t k) {
+  if (LIKELY(ad->isVector())) {
+    auto a = static_cast<const HphpArray*>(ad);
+    if (LIKELY(size_t(k) < a->m_size)) return &a->m_data[k].data;
+  }
+  return nullptr;
+}
+
+inline bool HphpArray::SetIntVecFast(ArrayData* ad, int64_t k,
+                                     const Cell& v) {
+  if (LIKELY(ad->isVector()) && LIKELY(ad->getCount() <= 1)) {
+    auto a = static_cast<HphpArray*>(ad);
+    if (LIKELY(size_t(k) < a->m_size)) {
+      tvSet(v, a->m_data[k].data);
+      return true;
+    }
+  }
+  return false;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
@@ -31,10 +31,12 @@
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/server/http_server.h"
 #include "hphp/util/alloc.h"
+#include "hphp/util/maphuge.h"
 #include "hphp/util/process.h"
 #include "hphp/util/trace.h"
 
 #include <stdint.h>
+#include <sys/mman.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -182,6 +184,13 @@ MemoryManager::MemoryManager() : m_front(0), m_limit(0),
   m_sweep.next = m_sweep.prev = &m_sweep;
 }
 
+MemoryManager::~MemoryManager() {
+  for (auto slab : m_freeSlabs) {
+    munmap(slab, SLAB_SIZE);
+  }
+  m_freeSlabs.clear();
+}
+
 void MemoryManager::resetStats() {
   m_stats.usage = 0;
   m_stats.alloc = 0;
@@ -235,9 +244,15 @@ void MemoryManager::rollback() {
   for (unsigned int i = 0, n = m_smartAllocators.size(); i < n; i++) {
     m_smartAllocators[i]->clear();
   }
-  // free smart-malloc slabs
+  // Keep some smart-malloc slabs for the next request on this thread, so
+  // that it doesn't have to fault in (and re-promote to huge pages) fresh
+  // memory. Return the rest to the system.
   for (SlabIter i = m_slabs.begin(), end = m_slabs.end(); i != end; ++i) {
-    free(*i);
+    if (m_freeSlabs.size() < RuntimeOption::EvalSmartSlabRetainCount) {
+      m_freeSlabs.push_back(*i);
+    } else {
+      munmap(*i, SLAB_SIZE);
+    }
   }
   m_slabs.clear();
   // free large allocation blocks
@@ -250,6 +265,9 @@ void MemoryManager::rollback() {
   for (unsigned i = 0; i < kNumSizes; i++) {
     m_smartfree[i].clear();
   }
+  for (unsigned i = 0; i < kNumMediumSizes; i++) {
+    m_mediumfree[i].clear();
+  }
   m_front = m_limit = 0;
 }
 
@@ -278,12 +296,32 @@ void MemoryManager::checkMemory() {
 // (m_smartfree[i]).  Small blocks have an 8-byte SmallNode and
 // are swept en-masse when slabs are freed.
 //
-// Medium blocks use a 16-byte SweepNode header to maintain a doubly-linked
+// Medium blocks, up to kMaxMediumSize, are also carved from slabs, rounded
+// up to one of 4 size classes per power of two, and recycled through
+// m_mediumfree[i].  They have a 16-byte SweepNode header so that they are
+// 16-byte aligned, but only its padbytes field is used.
+//
+// Big blocks use a 16-byte SweepNode header to maintain a doubly-linked
 // list of blocks to free at request end.  smart_free can distinguish
-// SmallNode and SweepNode because valid next/prev pointers must be
-// larger than kMaxSmartSize.
+// the three because valid next/prev pointers must be larger than
+// kMaxMediumSize.
+//
+// Slabs are SLAB_SIZE-aligned anonymous mappings, so with
+// Eval.SmartSlabHugePages each one can be backed by a single transparent
+// huge page, and rollback() keeps up to Eval.SmartSlabRetainCount of them
+// per thread for the next request.
 //
 
+unsigned MemoryManager::mediumSizeClass(size_t& padbytes) {
+  assert(padbytes > kMaxSmartSize && padbytes <= kMaxMediumSize);
+  const size_t kSubMask = (1 << kLgMediumClassesPerDoubling) - 1;
+  unsigned lg = 63 - __builtin_clzl(padbytes - 1);
+  unsigned shift = lg - kLgMediumClassesPerDoubling;
+  size_t sub = ((padbytes - 1) >> shift) & kSubMask;
+  padbytes = (size_t(1) << lg) + ((sub + 1) << shift);
+  return ((lg - kLgMaxSmartSize) << kLgMediumClassesPerDoubling) + sub;
+}
+
 inline void* MemoryManager::smartMalloc(size_t nbytes) {
   assert(nbytes > 0);
   // add room for header before rounding up
@@ -303,6 +341,9 @@ inline void* MemoryManager::smartMalloc(size_t nbytes) {
     }
     return smartMallocSlab(padbytes);
   }
+  if (nbytes + sizeof(SweepNode) <= kMaxMediumSize) {
+    return smartMallocMedium(nbytes);
+  }
   return smartMallocBig(nbytes);
 }
 
@@ -318,6 +359,10 @@ inline void MemoryManager::smartFree(void* ptr) {
     m_stats.usage -= padbytes;
     return;
   }
+  if (padbytes <= kMaxMediumSize) {
+    smartFreeMedium(n);
+    return;
+  }
   smartFreeBig(n);
 }
 
@@ -333,6 +378,16 @@ inline void* MemoryManager::smartRealloc(void* ptr, size_t nbytes) {
     smartFree(ptr);
     return newmem;
   }
+  if (old_padbytes <= kMaxMediumSize) {
+    if (nbytes + sizeof(SweepNode) <= old_padbytes &&
+        nbytes + sizeof(SweepNode) > kMaxSmartSize) {
+      return ptr; // still fits its size class
+    }
+    void* newmem = smartMalloc(nbytes);
+    memcpy(newmem, ptr, std::min(old_padbytes - sizeof(SweepNode), nbytes));
+    smartFreeMedium(n);
+    return newmem;
+  }
   SweepNode* next = n->next;
   SweepNode* prev = n->prev;
   SweepNode* n2 = (SweepNode*) realloc(n, nbytes + sizeof(SweepNode));
@@ -350,12 +405,40 @@ inline void* MemoryManager::smartRealloc(void* ptr, size_t nbytes) {
  * Get a new slab, then allocate nbytes from it and install it in our
  * slab list.  Return the newly allocated nbytes-sized block.
  */
+char* MemoryManager::mapSlab() {
+  // Over-allocate so the slab can be aligned to its own size, which is what
+  // lets the kernel back it with one huge page.
+  size_t len = 2 * SLAB_SIZE;
+  char* mem = (char*)mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    throw OutOfMemoryException(SLAB_SIZE);
+  }
+  char* slab = (char*)((uintptr_t(mem) + SLAB_SIZE - 1) &
+                       ~uintptr_t(SLAB_SIZE - 1));
+  if (slab != mem) munmap(mem, slab - mem);
+  if (slab + SLAB_SIZE != mem + len) {
+    munmap(slab + SLAB_SIZE, mem + len - (slab + SLAB_SIZE));
+  }
+  if (RuntimeOption::EvalSmartSlabHugePages) {
+    hintHuge(slab, SLAB_SIZE);
+  }
+  return slab;
+}
+
 NEVER_INLINE char* MemoryManager::newSlab(size_t nbytes) {
   if (UNLIKELY(m_stats.usage > m_stats.maxBytes)) {
     refreshStatsHelper();
   }
-  char* slab = (char*) Util::safe_malloc(SLAB_SIZE);
-  JEMALLOC_STATS_ADJUST(&m_stats, SLAB_SIZE);
+  // Slabs are mmapped rather than malloced, so there is no jemalloc
+  // accounting to adjust for.
+  char* slab;
+  if (!m_freeSlabs.empty()) {
+    slab = m_freeSlabs.back();
+    m_freeSlabs.pop_back();
+  } else {
+    slab = mapSlab();
+  }
   m_stats.alloc += SLAB_SIZE;
   if (m_stats.alloc > m_stats.peakAlloc) {
     m_stats.peakAlloc = m_stats.alloc;
@@ -386,6 +469,32 @@ inline void* MemoryManager::smartEnlist(SweepNode* n) {
   return n + 1;
 }
 
+NEVER_INLINE
+void* MemoryManager::smartMallocMedium(size_t nbytes) {
+  size_t padbytes = nbytes + sizeof(SweepNode);
+  unsigned i = mediumSizeClass(padbytes);
+  assert(i < kNumMediumSizes);
+  m_stats.usage += padbytes;
+  if (UNLIKELY(m_stats.usage > m_stats.maxBytes)) {
+    refreshStatsHelper();
+  }
+  void* p = m_mediumfree[i].maybePop();
+  if (p != 0) return p;
+  SweepNode* n = (SweepNode*) slabAlloc(padbytes);
+  n->padbytes = padbytes;
+  return n + 1;
+}
+
+NEVER_INLINE
+void MemoryManager::smartFreeMedium(SweepNode* n) {
+  size_t padbytes = n->padbytes;
+  unsigned i = mediumSizeClass(padbytes);
+  assert(padbytes == n->padbytes);
+  assert(memset(n + 1, kSmartFreeFill, padbytes - sizeof(SweepNode)));
+  m_mediumfree[i].push(n + 1);
+  m_stats.usage -= padbytes;
+}
+
 NEVER_INLINE
 void* MemoryManager::smartMallocBig(size_t nbytes) {
   assert(nbytes > 0);
@@ -436,7 +545,7 @@ void* smart_malloc(size_t nbytes) {
 HOT_FUNC
 void* smart_calloc(size_t count, size_t nbytes) {
   size_t totalbytes = std::max(nbytes * count, size_t(1));
-  if (totalbytes <= MemoryManager::kMaxSmartSize) {
+  if (totalbytes + sizeof(SweepNode) <= MemoryManager::kMaxMediumSize) {
     return memset(MM().smartMalloc(totalbytes), 0, totalbytes);
   }
   return MM().smartCallocBig(totalbytes);
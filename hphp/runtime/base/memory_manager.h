@@ -164,6 +164,7 @@ public:
   }
 
   MemoryManager();
+  ~MemoryManager();
 
   // State for iteration over all the smart allocators registered in a
   // memory manager.
@@ -329,14 +330,23 @@ public:
   void* smartCallocBig(size_t totalbytes);
   void  smartFree(void* ptr);
   static const size_t kMaxSmartSize = 2048;
+  static const size_t kMaxMediumSize = 64 << 10;
+  static const unsigned kNumMediumSizes = 20;
+
+  // Returns the size class for a medium block of padbytes (header
+  // included), and rounds padbytes up to that class's size.
+  static unsigned mediumSizeClass(size_t& padbytes);
 
   // allocate nbytes from the current slab, aligned to 16-bytes
   void* slabAlloc(size_t nbytes);
 
 private:
   char* newSlab(size_t nbytes);
+  static char* mapSlab();
   void* smartEnlist(SweepNode*);
   void* smartMallocSlab(size_t padbytes);
+  void* smartMallocMedium(size_t nbytes);
+  void  smartFreeMedium(SweepNode*);
   void* smartMallocBig(size_t nbytes);
   void  smartFreeBig(SweepNode*);
   void refreshStatsHelperExceeded();
@@ -349,15 +359,27 @@ private:
   static const unsigned kNumSizes = kMaxSmartSize >> kLgSizeQuantum;
   static const size_t kMask = (1 << kLgSizeQuantum) - 1;
 
+  // Medium blocks come in 4 size classes per power of two, from
+  // kMaxSmartSize up to kMaxMediumSize.
+  static const unsigned kLgMaxSmartSize = 11;
+  static const unsigned kLgMediumClassesPerDoubling = 2;
+  static_assert(kMaxSmartSize == 1u << kLgMaxSmartSize,
+                "kLgMaxSmartSize is stale");
+  static_assert(kMaxMediumSize == kMaxSmartSize << (kNumMediumSizes >>
+                                                    kLgMediumClassesPerDoubling),
+                "kNumMediumSizes is stale");
+
 private:
   char *m_front, *m_limit;
   GarbageList m_smartfree[kNumSizes];
+  GarbageList m_mediumfree[kNumMediumSizes];
   SweepNode m_sweep;   // oversize smart_malloc'd blocks
   MemoryUsageStats m_stats;
   bool m_enabled;
 
   std::vector<SmartAllocatorImpl*> m_smartAllocators;
   std::vector<char*> m_slabs;
+  std::vector<char*> m_freeSlabs; // kept across requests by rollback()
 
 #ifdef USE_JEMALLOC
   uint64_t* m_allocated;
@@ -384,8 +406,10 @@ public:
 // survive beyond a request, they'll be dangling pointers.
 //
 // Block sizes <= MemoryManager::kMaxSmartSize are region-allocated
-// and are only guaranteed to be 8-byte aligned.  Larger blocks are
-// directly malloc'd (with a header) and are 16-byte aligned.
+// and are only guaranteed to be 8-byte aligned.  Blocks up to
+// kMaxMediumSize are region-allocated in coarser size classes, and
+// larger blocks are directly malloc'd (with a header); both are 16-byte
+// aligned.
 //
 // Clients must not mix/match calls between smart_malloc and malloc:
 //  - these blocks have a header that malloc wouldn't grok
@@ -14,6 +14,7 @@
    | license@zend.com so we can mail you a copy immediately.              |
    +----------------------------------------------------------------------+
 */
+#include "hphp/runtime/base/preg.h"
 #include "hphp/runtime/base/string_util.h"
 #include "hphp/runtime/base/request_local.h"
 #include "hphp/util/lock.h"
@@ -26,7 +27,9 @@
 #include "hphp/runtime/base/array_iterator.h"
 #include "hphp/runtime/base/ini_setting.h"
 #include "hphp/runtime/base/thread_init_fini.h"
+#include "hphp/runtime/vm/treadmill.h"
 #include "tbb/concurrent_hash_map.h"
+#include <atomic>
 
 #define PREG_PATTERN_ORDER          1
 #define PREG_SET_ORDER              2
@@ -55,21 +58,43 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 // regex cache and helpers
 
+static void pcre_free_extra(pcre_extra* extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+  pcre_free_study(extra);
+#else
+  free(extra); // we don't have pcre_free_study yet
+#endif
+}
+
 class pcre_cache_entry {
   pcre_cache_entry(const pcre_cache_entry&);
   pcre_cache_entry& operator=(const pcre_cache_entry&);
 
 public:
-  pcre_cache_entry() {}
+  explicit pcre_cache_entry(CStrRef regex) : used(false) {
+    // The cache owns its keys instead of interning them as static strings,
+    // so evicted patterns don't leak.
+    key = (StringData*)malloc(sizeof(StringData));
+    new (key) StringData(regex.data(), regex.size(), CopyMalloc);
+    key->hash();
+  }
   ~pcre_cache_entry() {
-    if (extra) free(extra); // we don't have pcre_free_study yet
+    if (extra) pcre_free_extra(extra);
     pcre_free(re);
+    key->~StringData();
+    free(key);
   }
 
+  StringData *key;
   pcre *re;
   pcre_extra *extra; // Holds results of studying
   int preg_options;
   int compile_options;
+  int num_subpats; // including the whole match
+
+  // CLOCK reference bit: set on every hit, cleared when the entry survives
+  // an eviction round.
+  mutable std::atomic<bool> used;
 };
 
 struct ahm_string_data_same {
@@ -82,70 +107,165 @@ typedef folly::AtomicHashArray<const StringData*, const pcre_cache_entry*,
                          string_data_hash, ahm_string_data_same> PCREStringMap;
 typedef std::pair<const StringData*, const pcre_cache_entry*> PCREEntry;
 
-static PCREStringMap* s_pcreCacheMap;
+/*
+ * Compiled regexes live in a fixed-size AtomicHashArray so that hits never
+ * take a lock. AtomicHashArrays can't reclaim slots, so when the table
+ * fills up we build a new one holding the entries that were hit since the
+ * previous round (a CLOCK-style second chance, capped at half the table),
+ * publish it, and hand the old table and the evicted entries to the
+ * treadmill: requests still running may be holding pointers into them.
+ *
+ * Misses compile the pattern without any lock held, then take
+ * s_pcreCacheLock to insert, so eviction never races with an insert.
+ */
+static std::atomic<PCREStringMap*> s_pcreCacheMap(nullptr);
+static SimpleMutex s_pcreCacheLock;
+
+static std::atomic<int64_t> s_pcreCacheHits(0);
+static std::atomic<int64_t> s_pcreCacheMisses(0);
+static std::atomic<int64_t> s_pcreCacheEvictions(0);
+
+// Hits are counted per thread and folded into s_pcreCacheHits in batches,
+// to keep a shared cache line out of the hit path.
+static __thread uint32_t t_pcreCacheHits;
+static const uint32_t kPCREHitBatch = 256;
+
+static PCREStringMap* pcre_create_map() {
+  PCREStringMap::Config config;
+  config.maxLoadFactor = 0.5;
+  return PCREStringMap::create(
+           RuntimeOption::EvalPCRETableSize, config).release();
+}
+
+namespace {
+
+struct PCRECacheReclaimer : Treadmill::WorkItem {
+  PCRECacheReclaimer(PCREStringMap* map,
+                     std::vector<const pcre_cache_entry*>&& evicted)
+    : m_map(map), m_evicted(std::move(evicted)) {}
+
+  virtual void operator()() {
+    for (auto ent : m_evicted) delete ent;
+    PCREStringMap::destroy(m_map);
+  }
+
+private:
+  PCREStringMap* m_map;
+  std::vector<const pcre_cache_entry*> m_evicted;
+};
+
+}
 
 void pcre_init() {
-  if (!s_pcreCacheMap) {
-    PCREStringMap::Config config;
-    config.maxLoadFactor = 0.5;
-    s_pcreCacheMap = PCREStringMap::create(
-                       RuntimeOption::EvalPCRETableSize, config).release();
+  if (!s_pcreCacheMap.load()) {
+    s_pcreCacheMap.store(pcre_create_map());
   }
 }
 
 void pcre_reinit() {
-  PCREStringMap::Config config;
-  config.maxLoadFactor = 0.5;
-  PCREStringMap* newMap = PCREStringMap::create(
-                     RuntimeOption::EvalPCRETableSize, config).release();
-  if (s_pcreCacheMap) {
+  PCREStringMap* newMap = pcre_create_map();
+  PCREStringMap* oldMap = s_pcreCacheMap.exchange(newMap);
+  if (oldMap) {
     PCREStringMap::iterator it;
-    for (it = s_pcreCacheMap->begin(); it != s_pcreCacheMap->end(); it++) {
+    for (it = oldMap->begin(); it != oldMap->end(); it++) {
       // there should not be a lot of entries created before runtime
       // options were parsed.
       delete(it->second);
     }
-    PCREStringMap::destroy(s_pcreCacheMap);
+    PCREStringMap::destroy(oldMap);
   }
-  s_pcreCacheMap = newMap;
 }
 
 static const pcre_cache_entry* lookup_cached_pcre(CStrRef regex) {
-  assert(s_pcreCacheMap);
+  PCREStringMap* map = s_pcreCacheMap.load(std::memory_order_acquire);
+  assert(map);
   PCREStringMap::iterator it;
-  if ((it = s_pcreCacheMap->find(regex.get())) != s_pcreCacheMap->end()) {
-    return it->second;
+  if ((it = map->find(regex.get())) != map->end()) {
+    const pcre_cache_entry* ent = it->second;
+    if (!ent->used.load(std::memory_order_relaxed)) {
+      ent->used.store(true, std::memory_order_relaxed);
+    }
+    if (++t_pcreCacheHits == kPCREHitBatch) {
+      s_pcreCacheHits += kPCREHitBatch;
+      t_pcreCacheHits = 0;
+    }
+    return ent;
   }
   return 0;
 }
 
+/*
+ * Replace the current table with one holding only recently used entries.
+ * Must be called with s_pcreCacheLock held.
+ */
+static PCREStringMap* evict_cached_pcre() {
+  PCREStringMap* oldMap = s_pcreCacheMap.load(std::memory_order_relaxed);
+  PCREStringMap* newMap = pcre_create_map();
+  size_t keep = RuntimeOption::EvalPCRETableSize / 2;
+  std::vector<const pcre_cache_entry*> evicted;
+  for (auto it = oldMap->begin(); it != oldMap->end(); ++it) {
+    const pcre_cache_entry* ent = it->second;
+    if (keep && ent->used.load(std::memory_order_relaxed)) {
+      ent->used.store(false, std::memory_order_relaxed);
+      newMap->insert(PCREEntry(ent->key, ent));
+      --keep;
+    } else {
+      evicted.push_back(ent);
+    }
+  }
+  s_pcreCacheEvictions += evicted.size();
+  s_pcreCacheMap.store(newMap, std::memory_order_release);
+  Treadmill::WorkItem::enqueue(
+    new PCRECacheReclaimer(oldMap, std::move(evicted)));
+  return newMap;
+}
+
 static const pcre_cache_entry*
 insert_cached_pcre(CStrRef regex, const pcre_cache_entry* ent) {
-  assert(s_pcreCacheMap);
-  auto pair = s_pcreCacheMap->insert(
-    PCREEntry(StringData::GetStaticString(regex.get()), ent));
+  SimpleLock lock(s_pcreCacheLock);
+  PCREStringMap* map = s_pcreCacheMap.load(std::memory_order_relaxed);
+  assert(map);
+  if (map->size() >= RuntimeOption::EvalPCRETableSize) {
+    map = evict_cached_pcre();
+  }
+  auto pair = map->insert(PCREEntry(ent->key, ent));
   if (!pair.second) {
+    // someone else compiled the same pattern first
     delete ent;
-    if (s_pcreCacheMap->size() < RuntimeOption::EvalPCRETableSize) {
-      return pair.first->second;
-    }
-    // if the AHA is too small, fail.
-    raise_error("PCRE cache full");
+    return pair.first->second;
   }
+  ++s_pcreCacheMisses;
   return ent;
 }
 
+// The last pcre error code is available for the whole thread.
+static __thread int t_last_error_code;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
 /*
- * When a cached compiled pcre doesn't have pcre_extra, we use this
- * one.
- *
- * FIXME: It's unclear why this needs to be thread-local data instead
- * of just existing on the stack during the calls to preg_ functions.
+ * JIT-compiled patterns run on a pcre_jit_stack instead of the machine
+ * stack. Compiled patterns are shared between threads, so rather than
+ * assigning a stack to each pattern we hand PCRE a callback returning the
+ * calling thread's stack, allocated on first use.
  */
-static __thread pcre_extra t_extra_data;
+static __thread pcre_jit_stack* t_jit_stack;
 
-// The last pcre error code is available for the whole thread.
-static __thread int t_last_error_code;
+static pcre_jit_stack* pcre_get_jit_stack(void*) {
+  if (!t_jit_stack) {
+    t_jit_stack = pcre_jit_stack_alloc(32 * 1024,
+                                       RuntimeOption::EvalPCREJitStackSize);
+  }
+  return t_jit_stack;
+}
+
+static bool pcre_jit_enabled() {
+  static const bool supported = [] {
+    int jit = 0;
+    return pcre_config(PCRE_CONFIG_JIT, &jit) == 0 && jit;
+  }();
+  return supported && RuntimeOption::EvalPCREJit;
+}
+#endif
 
 namespace {
 
@@ -159,6 +279,16 @@ static void preg_init_thread_locals() {
 }
 InitFiniNode init(preg_init_thread_locals, InitFiniNode::When::ThreadInit);
 
+#ifdef PCRE_STUDY_JIT_COMPILE
+static void preg_free_jit_stack() {
+  if (t_jit_stack) {
+    pcre_jit_stack_free(t_jit_stack);
+    t_jit_stack = nullptr;
+  }
+}
+InitFiniNode fini(preg_free_jit_stack, InitFiniNode::When::ThreadFini);
+#endif
+
 template<bool useSmartFree = false>
 struct FreeHelperImpl : private boost::noncopyable {
   explicit FreeHelperImpl(void* p) : p(p) {}
@@ -301,14 +431,29 @@ static const pcre_cache_entry* pcre_get_compiled_regex_cache(CStrRef regex) {
   // Careful: from here 're' needs to be freed if something throws.
 
   /* If study option was specified, study the pattern and
-     store the result in extra for passing to pcre_exec. */
+     store the result in extra for passing to pcre_exec. When the PCRE JIT
+     is available every pattern is studied, so that it gets compiled to
+     machine code. */
   pcre_extra *extra = nullptr;
+  int soptions = 0;
+#ifdef PCRE_STUDY_JIT_COMPILE
+  if (pcre_jit_enabled()) {
+    soptions |= PCRE_STUDY_JIT_COMPILE;
+    do_study = true;
+  }
+#endif
   if (do_study) {
-    int soptions = 0;
     extra = pcre_study(re, soptions, &error);
     if (extra) {
       extra->flags |= PCRE_EXTRA_MATCH_LIMIT |
         PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+#ifdef PCRE_STUDY_JIT_COMPILE
+      int jitted = 0;
+      if ((soptions & PCRE_STUDY_JIT_COMPILE) &&
+          pcre_fullinfo(re, extra, PCRE_INFO_JIT, &jitted) == 0 && jitted) {
+        pcre_assign_jit_stack(extra, pcre_get_jit_stack, nullptr);
+      }
+#endif
     }
     if (error != nullptr) {
       try {
@@ -320,42 +465,71 @@ static const pcre_cache_entry* pcre_get_compiled_regex_cache(CStrRef regex) {
     }
   }
 
+  /* Calculate the size of the offsets array once, at compile time. */
+  int num_subpats;
+  int rc = pcre_fullinfo(re, extra, PCRE_INFO_CAPTURECOUNT, &num_subpats);
+  if (rc < 0) {
+    if (extra) pcre_free_extra(extra);
+    pcre_free(re);
+    raise_warning("Internal pcre_fullinfo() error %d", rc);
+    return nullptr;
+  }
+
   /* Store the compiled pattern and extra info in the cache. */
-  pcre_cache_entry *new_entry = new pcre_cache_entry();
+  pcre_cache_entry *new_entry = new pcre_cache_entry(regex);
   new_entry->re = re;
   new_entry->extra = extra;
   new_entry->preg_options = poptions;
   new_entry->compile_options = coptions;
+  new_entry->num_subpats = num_subpats + 1;
   return insert_cached_pcre(regex, new_entry);
 }
 
-static void set_extra_limits(pcre_extra*& extra) {
-  if (extra == nullptr) {
-    pcre_extra& extra_data = t_extra_data;
-    extra_data.flags = PCRE_EXTRA_MATCH_LIMIT |
-      PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-    extra = &extra_data;
+/*
+ * The cached pcre_extra is shared by every thread using the pattern, so
+ * each call takes a copy on its own stack and sets the request's limits
+ * there.
+ */
+static pcre_extra* set_extra_limits(const pcre_extra* shared,
+                                    pcre_extra& local) {
+  if (shared) {
+    local = *shared;
+  } else {
+    memset(&local, 0, sizeof(local));
   }
-  extra->match_limit = g_context->m_preg_backtrace_limit;
-  extra->match_limit_recursion = g_context->m_preg_recursion_limit;
+  local.flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+  local.match_limit = g_context->m_preg_backtrace_limit;
+  local.match_limit_recursion = g_context->m_preg_recursion_limit;
+  return &local;
 }
 
-static int *create_offset_array(const pcre_cache_entry *pce,
-                                int &size_offsets) {
-  pcre_extra *extra = pce->extra;
-  set_extra_limits(extra);
-
-  /* Calculate the size of the offsets array, and allocate memory for it. */
-  int num_subpats; // Number of captured subpatterns
-  int rc = pcre_fullinfo(pce->re, extra, PCRE_INFO_CAPTURECOUNT, &num_subpats);
-  if (rc < 0) {
-    raise_warning("Internal pcre_fullinfo() error %d", rc);
-    return nullptr;
+/*
+ * The offsets vector handed to pcre_exec(). Most patterns have only a few
+ * subpatterns, so the vector normally lives in an inline buffer on the
+ * caller's stack; that also keeps it safe when a replacement callback
+ * re-enters preg_*. Larger vectors come from smart_malloc.
+ */
+class PCREOffsets : private boost::noncopyable {
+public:
+  explicit PCREOffsets(const pcre_cache_entry *pce)
+    : m_size(pce->num_subpats * 3)
+    , m_data(m_size <= kInlineSize ? m_inline
+                                   : (int *)smart_malloc(m_size * sizeof(int)))
+  {}
+  ~PCREOffsets() {
+    if (m_data != m_inline) smart_free(m_data);
   }
-  num_subpats++;
-  size_offsets = num_subpats * 3;
-  return (int *)smart_malloc(size_offsets * sizeof(int));
-}
+
+  int *data() { return m_data; }
+  int size() const { return m_size; }
+
+private:
+  static const int kInlineSize = 16 * 3;
+
+  int m_size;
+  int *m_data;
+  int m_inline[kInlineSize];
+};
 
 static pcre* pcre_get_compiled_regex(CStrRef regex, pcre_extra **extra,
                                      int *preg_options) {
@@ -446,12 +620,9 @@ Variant preg_grep(CStrRef pattern, CArrRef input, int flags /* = 0 */) {
     return false;
   }
 
-  int size_offsets = 0;
-  int *offsets = create_offset_array(pce, size_offsets);
-  if (offsets == nullptr) {
-    return false;
-  }
-  SmartFreeHelper freer(offsets);
+  PCREOffsets offsetArray(pce);
+  int size_offsets = offsetArray.size();
+  int *offsets = offsetArray.data();
 
   /* Initialize return array */
   Array ret = Array::Create();
@@ -459,8 +630,8 @@ Variant preg_grep(CStrRef pattern, CArrRef input, int flags /* = 0 */) {
 
   /* Go through the input array */
   bool invert = (flags & PREG_GREP_INVERT);
-  pcre_extra *extra = pce->extra;
-  set_extra_limits(extra);
+  pcre_extra extra_data;
+  pcre_extra *extra = set_extra_limits(pce->extra, extra_data);
 
   for (ArrayIter iter(input); iter; ++iter) {
     String entry = iter.second().toString();
@@ -507,8 +678,8 @@ static Variant preg_match_impl(CStrRef pattern, CStrRef subject,
     return false;
   }
 
-  pcre_extra *extra = pce->extra;
-  set_extra_limits(extra);
+  pcre_extra extra_data;
+  pcre_extra *extra = set_extra_limits(pce->extra, extra_data);
   if (subpats) {
     *subpats = Array::Create();
   }
@@ -541,13 +712,10 @@ static Variant preg_match_impl(CStrRef pattern, CStrRef subject,
     }
   }
 
-  int size_offsets = 0;
-  int *offsets = create_offset_array(pce, size_offsets);
-  SmartFreeHelper offsetsFreer(offsets);
-  int num_subpats = size_offsets / 3;
-  if (offsets == nullptr) {
-    return false;
-  }
+  PCREOffsets offsetArray(pce);
+  int size_offsets = offsetArray.size();
+  int *offsets = offsetArray.data();
+  int num_subpats = pce->num_subpats;
 
   /*
    * Build a mapping from subpattern numbers to their names. We will always
@@ -834,12 +1002,9 @@ static String php_pcre_replace(CStrRef pattern, CStrRef subject,
     eval = true;
   }
 
-  int size_offsets;
-  int *offsets = create_offset_array(pce, size_offsets);
-  SmartFreeHelper offsetsFreer(offsets);
-  if (offsets == nullptr) {
-    return false;
-  }
+  PCREOffsets offsetArray(pce);
+  int size_offsets = offsetArray.size();
+  int *offsets = offsetArray.data();
 
   const char *replace = nullptr;
   const char *replace_end = nullptr;
@@ -880,8 +1045,8 @@ static String php_pcre_replace(CStrRef pattern, CStrRef subject,
     const char *match = nullptr;
     int start_offset = 0;
     t_last_error_code = PHP_PCRE_NO_ERROR;
-    pcre_extra *extra = pce->extra;
-    set_extra_limits(extra);
+    pcre_extra extra_data;
+    pcre_extra *extra = set_extra_limits(pce->extra, extra_data);
 
     int result_len = 0;
     int new_len;        // Length of needed storage
@@ -1184,12 +1349,9 @@ Variant preg_split(CVarRef pattern, CVarRef subject, int limit /* = -1 */,
     limit = -1;
   }
 
-  int size_offsets = 0;
-  int *offsets = create_offset_array(pce, size_offsets);
-  SmartFreeHelper offsetsFreer(offsets);
-  if (offsets == nullptr) {
-    return false;
-  }
+  PCREOffsets offsetArray(pce);
+  int size_offsets = offsetArray.size();
+  int *offsets = offsetArray.data();
 
   String ssubject = subject.toString();
 
@@ -1198,7 +1360,8 @@ Variant preg_split(CVarRef pattern, CVarRef subject, int limit /* = -1 */,
   int next_offset = 0;
   const char *last_match = ssubject.data();
   t_last_error_code = PHP_PCRE_NO_ERROR;
-  pcre_extra *extra = pce->extra;
+  pcre_extra extra_data;
+  pcre_extra *extra = set_extra_limits(pce->extra, extra_data);
 
   // Get next piece if no limit or limit not yet reached and something matched
   Variant return_value = Array::Create();
@@ -1403,7 +1566,15 @@ int preg_last_error() {
 }
 
 size_t preg_pcre_cache_size() {
-  return (size_t)s_pcreCacheMap->size();
+  return (size_t)s_pcreCacheMap.load()->size();
+}
+
+void preg_pcre_cache_stats(PCRECacheStats& stats) {
+  stats.size = preg_pcre_cache_size();
+  stats.capacity = RuntimeOption::EvalPCRETableSize;
+  stats.hits = s_pcreCacheHits.load();
+  stats.misses = s_pcreCacheMisses.load();
+  stats.evictions = s_pcreCacheEvictions.load();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -55,6 +55,19 @@ int preg_last_error();
 
 size_t preg_pcre_cache_size();
 
+/*
+ * Compiled regex cache counters. Hits are aggregated in per-thread batches,
+ * so they lag behind by up to a few hundred per thread.
+ */
+struct PCRECacheStats {
+  size_t size;
+  size_t capacity;
+  int64_t hits;
+  int64_t misses;
+  int64_t evictions;
+};
+void preg_pcre_cache_stats(PCRECacheStats& stats);
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
@@ -66,6 +66,7 @@
 
 #include "hphp/runtime/vm/runtime.h"
 #include "hphp/runtime/vm/repo.h"
+#include "hphp/runtime/vm/stack_sampler.h"
 #include "hphp/runtime/vm/jit/translator.h"
 #include "hphp/compiler/builtin_symbols.h"
 
@@ -660,6 +661,13 @@ static int start_server(const std::string &username) {
   // initialize the process
   HttpServer::Server = HttpServerPtr(new HttpServer(sslCTX));
 
+  // Load the units the last run ended up using, alongside the warmup
+  // requests and the first real ones.
+  if (!RuntimeOption::RepoHotUnitsFile.empty()) {
+    Eval::FileRepository::prefetchUnits(RuntimeOption::RepoHotUnitsFile,
+                                        RuntimeOption::RepoPrefetchThreads);
+  }
+
   // If we have any warmup requests, replay them before listening for
   // real connections
   for (auto& file : RuntimeOption::ServerWarmupRequests) {
@@ -682,10 +690,19 @@ static int start_server(const std::string &username) {
     }
   }
 
+  if (RuntimeOption::SampleProfilerInterval > 0) {
+    StackSampler::Start(RuntimeOption::SampleProfilerInterval);
+  }
+
   for (InitFiniNode *in = extra_server_init; in; in = in->next) {
     in->func();
   }
   HttpServer::Server->run();
+  if (!RuntimeOption::RepoHotUnitsFile.empty() &&
+      !Eval::FileRepository::saveUnitList(RuntimeOption::RepoHotUnitsFile)) {
+    Logger::Error("Unable to write %s",
+                  RuntimeOption::RepoHotUnitsFile.c_str());
+  }
   for (InitFiniNode *in = extra_server_exit; in; in = in->next) {
     in->func();
   }
@@ -1327,6 +1344,7 @@ void hphp_process_init() {
   int64_t save = RuntimeOption::SerializationSizeLimit;
   RuntimeOption::SerializationSizeLimit = StringData::MaxSize;
   apc_load(RuntimeOption::ApcLoadThread);
+  apc_load_snapshot();
   RuntimeOption::SerializationSizeLimit = save;
 
   Transl::TargetCache::requestExit();
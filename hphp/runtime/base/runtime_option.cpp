@@ -87,6 +87,8 @@ int64_t RuntimeOption::StringOffsetLimit = 10 * 1024 * 1024; // 10MB
 
 std::string RuntimeOption::AccessLogDefaultFormat;
 std::vector<AccessLogFileData> RuntimeOption::AccessLogs;
+bool RuntimeOption::AccessLogAsync = false;
+int RuntimeOption::AccessLogQueueSize = 65536;
 
 std::string RuntimeOption::AdminLogFormat;
 std::string RuntimeOption::AdminLogFile;
@@ -110,6 +112,7 @@ int RuntimeOption::ServerWarmupThrottleRequestCount =
   kDefaultWarmupThrottleRequestCount;
 int RuntimeOption::ServerThreadDropCacheTimeoutSeconds = 0;
 int RuntimeOption::ServerThreadJobLIFOSwitchThreshold = INT_MAX;
+bool RuntimeOption::ServerThreadJobWorkStealing = false;
 bool RuntimeOption::ServerThreadDropStack = false;
 bool RuntimeOption::ServerHttpSafeMode = false;
 bool RuntimeOption::ServerStatCache = true;
@@ -206,6 +209,9 @@ bool RuntimeOption::EnableStaticContentCache = true;
 bool RuntimeOption::EnableStaticContentFromDisk = true;
 bool RuntimeOption::EnableOnDemandUncompress = true;
 bool RuntimeOption::EnableStaticContentMMap = true;
+bool RuntimeOption::EnableStaticContentSendFile = false;
+bool RuntimeOption::EnableStaticContentGzipSiblings = false;
+int RuntimeOption::StaticFileFdCacheSize = 4096;
 
 bool RuntimeOption::Utf8izeReplace = true;
 
@@ -259,9 +265,13 @@ bool RuntimeOption::MySQLKillOnTimeout = false;
 int RuntimeOption::MySQLMaxRetryOpenOnFail = 1;
 int RuntimeOption::MySQLMaxRetryQueryOnFail = 1;
 std::string RuntimeOption::MySQLSocket = "";
+int RuntimeOption::MySQLConnectionPoolSize = 0;
+int RuntimeOption::MySQLConnectionPoolIdleTimeout = 60000;
+int RuntimeOption::MySQLAsyncQueryThreadCount = 8;
 
 int RuntimeOption::HttpDefaultTimeout = 30;
 int RuntimeOption::HttpSlowQueryThreshold = 5000; // ms
+int RuntimeOption::HttpAsyncMaxConnections = 64;
 
 bool RuntimeOption::TranslateLeakStackTrace = false;
 bool RuntimeOption::NativeStackTrace = false;
@@ -285,6 +295,7 @@ bool RuntimeOption::MemcacheReadOnly = false;
 
 bool RuntimeOption::EnableStats = false;
 bool RuntimeOption::EnableWebStats = false;
+bool RuntimeOption::EnableHWCounterStats = false;
 bool RuntimeOption::EnableMemoryStats = false;
 bool RuntimeOption::EnableMallocStats = false;
 bool RuntimeOption::EnableAPCStats = false;
@@ -331,6 +342,10 @@ int RuntimeOption::ApcLoadThread = 1;
 std::set<std::string> RuntimeOption::ApcCompletionKeys;
 RuntimeOption::ApcTableTypes RuntimeOption::ApcTableType =
   ApcTableTypes::ApcConcurrentTable;
+int RuntimeOption::ApcShardCount = 16;
+int64_t RuntimeOption::ApcMemoryLimit = 0;
+std::string RuntimeOption::ApcSnapshotFile;
+bool RuntimeOption::ApcSnapshotOnShutdown = true;
 bool RuntimeOption::EnableApcSerialize = true;
 time_t RuntimeOption::ApcKeyMaturityThreshold = 20;
 size_t RuntimeOption::ApcMaximumCapacity = 0;
@@ -426,6 +441,9 @@ std::string RuntimeOption::RepoEvalMode;
 std::string RuntimeOption::RepoJournal;
 bool RuntimeOption::RepoCommit = true;
 bool RuntimeOption::RepoDebugInfo = true;
+bool RuntimeOption::RepoPreloadStaticStrings = true;
+std::string RuntimeOption::RepoHotUnitsFile;
+int RuntimeOption::RepoPrefetchThreads = 4;
 // Missing: RuntimeOption::RepoAuthoritative's physical location is
 // perf-sensitive.
 
@@ -464,6 +482,7 @@ bool RuntimeOption::EnableHotProfiler = true;
 int RuntimeOption::ProfilerTraceBuffer = 2000000;
 double RuntimeOption::ProfilerTraceExpansion = 1.2;
 int RuntimeOption::ProfilerMaxTraceBuffer = 0;
+int RuntimeOption::SampleProfilerInterval = 0;
 
 #ifdef FACEBOOK
 bool RuntimeOption::EnableFb303Server = true;
@@ -638,6 +657,9 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
       }
     }
 
+    AccessLogAsync = logger["AccessLogAsync"].getBool(false);
+    AccessLogQueueSize = logger["AccessLogQueueSize"].getInt32(65536);
+
     AdminLogFormat = logger["AdminLog.Format"].getString("%h %t %s %U");
     AdminLogFile = logger["AdminLog.File"].getString();
     AdminLogSymLink = logger["AdminLog.SymLink"].getString();
@@ -706,6 +728,7 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     ServerThreadJobLIFOSwitchThreshold =
       server["ThreadJobLIFOSwitchThreshold"].getInt32(
         ServerThreadJobLIFOSwitchThreshold);
+    ServerThreadJobWorkStealing = server["ThreadJobWorkStealing"].getBool();
     ServerThreadDropStack = server["ThreadDropStack"].getBool();
     ServerHttpSafeMode = server["HttpSafeMode"].getBool();
     ServerStatCache = server["StatCache"].getBool(true);
@@ -794,6 +817,11 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     if (EnableStaticContentMMap) {
       EnableOnDemandUncompress = true;
     }
+    EnableStaticContentSendFile =
+      server["EnableStaticContentSendFile"].getBool(false);
+    EnableStaticContentGzipSiblings =
+      server["EnableStaticContentGzipSiblings"].getBool(false);
+    StaticFileFdCacheSize = server["StaticFileFdCacheSize"].getInt32(4096);
     Utf8izeReplace = server["Utf8izeReplace"].getBool(true);
 
     StartupDocument = server["StartupDocument"].getString();
@@ -855,10 +883,20 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     string apcTableType = apc["TableType"].getString("concurrent");
     if (strcasecmp(apcTableType.c_str(), "concurrent") == 0) {
       ApcTableType = ApcTableTypes::ApcConcurrentTable;
+    } else if (strcasecmp(apcTableType.c_str(), "sharded") == 0) {
+      ApcTableType = ApcTableTypes::ApcShardedTable;
     } else {
       throw InvalidArgumentException("apc table type",
                                      "Invalid table type");
     }
+    ApcShardCount = apc["ShardCount"].getInt32(16);
+    if (ApcShardCount <= 0) {
+      throw InvalidArgumentException("apc shard count",
+                                     "Must be positive");
+    }
+    ApcMemoryLimit = apc["MemoryLimit"].getInt64(0);
+    ApcSnapshotFile = apc["SnapshotFile"].getString();
+    ApcSnapshotOnShutdown = apc["SnapshotOnShutdown"].getBool(true);
     EnableApcSerialize = apc["EnableApcSerialize"].getBool(true);
     ApcExpireOnSets = apc["ExpireOnSets"].getBool();
     ApcPurgeFrequency = apc["PurgeFrequency"].getInt32(4096);
@@ -1040,11 +1078,16 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     MySQLMaxRetryOpenOnFail = mysql["MaxRetryOpenOnFail"].getInt32(1);
     MySQLMaxRetryQueryOnFail = mysql["MaxRetryQueryOnFail"].getInt32(1);
     MySQLSocket = mysql["Socket"].getString();
+    MySQLConnectionPoolSize = mysql["ConnectionPoolSize"].getInt32(0);
+    MySQLConnectionPoolIdleTimeout =
+      mysql["ConnectionPoolIdleTimeout"].getInt32(60000);
+    MySQLAsyncQueryThreadCount = mysql["AsyncQueryThreadCount"].getInt32(8);
   }
   {
     Hdf http = config["Http"];
     HttpDefaultTimeout = http["DefaultTimeout"].getInt32(30);
     HttpSlowQueryThreshold = http["SlowQueryThreshold"].getInt32(5000);
+    HttpAsyncMaxConnections = http["AsyncMaxConnections"].getInt32(64);
   }
   {
     Hdf debug = config["Debug"];
@@ -1081,6 +1124,7 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     EnableStats = stats.getBool(); // main switch
 
     EnableWebStats = stats["Web"].getBool();
+    EnableHWCounterStats = stats["HardwareCounters"].getBool();
     EnableMemoryStats = stats["Memory"].getBool();
     EnableMallocStats = stats["Malloc"].getBool();
     EnableAPCStats = stats["APC"].getBool();
@@ -1129,6 +1173,7 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     ProfilerTraceBuffer = stats["ProfilerTraceBuffer"].getInt32(2000000);
     ProfilerTraceExpansion = stats["ProfilerTraceExpansion"].getDouble(1.2);
     ProfilerMaxTraceBuffer = stats["ProfilerMaxTraceBuffer"].getInt32(0);
+    SampleProfilerInterval = stats["SampleProfilerInterval"].getInt32(0);
   }
   {
     config["ServerVariables"].get(ServerVariables);
@@ -1264,6 +1309,9 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
       RepoCommit = repo["Commit"].getBool(true);
       RepoDebugInfo = repo["DebugInfo"].getBool(true);
       RepoAuthoritative = repo["Authoritative"].getBool(false);
+      RepoPreloadStaticStrings = repo["PreloadStaticStrings"].getBool(true);
+      RepoHotUnitsFile = repo["HotUnitsFile"].getString();
+      RepoPrefetchThreads = repo["PrefetchThreads"].getInt32(4);
     }
 
     // NB: after we know the value of RepoAuthoritative.
@@ -82,6 +82,8 @@ public:
 
   static std::string AccessLogDefaultFormat;
   static std::vector<AccessLogFileData> AccessLogs;
+  static bool AccessLogAsync;
+  static int AccessLogQueueSize;
 
   static std::string AdminLogFormat;
   static std::string AdminLogFile;
@@ -102,6 +104,7 @@ public:
   static bool ServerThreadRoundRobin;
   static int ServerThreadDropCacheTimeoutSeconds;
   static int ServerThreadJobLIFOSwitchThreshold;
+  static bool ServerThreadJobWorkStealing;
   static bool ServerThreadDropStack;
   static bool ServerHttpSafeMode;
   static bool ServerStatCache;
@@ -200,6 +203,9 @@ public:
   static bool EnableStaticContentFromDisk;
   static bool EnableOnDemandUncompress;
   static bool EnableStaticContentMMap;
+  static bool EnableStaticContentSendFile;
+  static bool EnableStaticContentGzipSiblings;
+  static int StaticFileFdCacheSize;
 
   static bool Utf8izeReplace;
 
@@ -253,9 +259,13 @@ public:
   static int  MySQLMaxRetryOpenOnFail;
   static int  MySQLMaxRetryQueryOnFail;
   static std::string MySQLSocket;
+  static int  MySQLConnectionPoolSize;
+  static int  MySQLConnectionPoolIdleTimeout;
+  static int  MySQLAsyncQueryThreadCount;
 
   static int  HttpDefaultTimeout;
   static int  HttpSlowQueryThreshold;
+  static int  HttpAsyncMaxConnections;
 
   static bool TranslateLeakStackTrace;
   static bool NativeStackTrace;
@@ -274,6 +284,7 @@ public:
 
   static bool EnableStats;
   static bool EnableWebStats;
+  static bool EnableHWCounterStats;
   static bool EnableMemoryStats;
   static bool EnableMallocStats;
   static bool EnableAPCStats;
@@ -302,6 +313,7 @@ public:
   static int32_t ProfilerTraceBuffer;
   static double ProfilerTraceExpansion;
   static int32_t ProfilerMaxTraceBuffer;
+  static int32_t SampleProfilerInterval;
 
   static int64_t MaxRSS;
   static int64_t MaxRSSPollingCycle;
@@ -323,9 +335,14 @@ public:
   static int ApcLoadThread;
   static std::set<std::string> ApcCompletionKeys;
   enum class ApcTableTypes {
-    ApcConcurrentTable
+    ApcConcurrentTable,
+    ApcShardedTable
   };
   static ApcTableTypes ApcTableType;
+  static int ApcShardCount;
+  static int64_t ApcMemoryLimit;
+  static std::string ApcSnapshotFile;
+  static bool ApcSnapshotOnShutdown;
   static bool EnableApcSerialize;
   static time_t ApcKeyMaturityThreshold;
   static size_t ApcMaximumCapacity;
@@ -414,6 +431,9 @@ public:
   F(int32_t, JitStressTypePredPercent, 0)                               \
   F(uint32_t, JitWarmupRequests,       kDefaultWarmupRequests)          \
   F(bool, JitProfileRecord,            false)                           \
+  F(bool, JitProfileWarmStart,         false)                           \
+  F(bool, SmartSlabHugePages,          true)                            \
+  F(uint32_t, SmartSlabRetainCount,    2)                               \
   F(uint32_t, GdbSyncChunks,           128)                             \
   F(bool, JitStressLease,              false)                           \
   F(bool, JitKeepDbgFiles,             false)                           \
@@ -445,6 +465,8 @@ public:
   F(bool, HHIRPredictionOpts,          true)                            \
   F(bool, HHIRStressCodegenBlocks,     false)                           \
   F(string, JitRegionSelector,         "")                              \
+  F(uint32_t, JitRegionMaxCondJmps,    4)                               \
+  F(double, JitRegionMinBranchBias,    0.99)                            \
   /* DumpBytecode =1 dumps user php, =2 dumps systemlib & user php */   \
   F(int32_t, DumpBytecode,             0)                               \
   F(bool, DumpTC,                      false)                           \
@@ -457,6 +479,8 @@ public:
   F(uint32_t, InitialNamedEntityTableSize,  30000)                      \
   F(uint32_t, InitialStaticStringTableSize, 100000)                     \
   F(uint32_t, PCRETableSize, kPCREInitialTableSize)                     \
+  F(bool, PCREJit,                     true)                            \
+  F(uint32_t, PCREJitStackSize,        1 << 20)                         \
   /* */                                                                 \
 
 #define F(type, name, unused) \
@@ -483,6 +507,9 @@ public:
   static bool RepoCommit;
   static bool RepoDebugInfo;
   static bool RepoAuthoritative;
+  static bool RepoPreloadStaticStrings;
+  static std::string RepoHotUnitsFile;
+  static int RepoPrefetchThreads;
 
   // Sandbox options
   static bool SandboxMode;
@@ -0,0 +1,185 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   | Copyright (c) 1998-2010 Zend Technologies Ltd. (http://www.zend.com) |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 2.00 of the Zend license,     |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.zend.com/license/2_00.txt.                                |
+   | If you did not receive a copy of the Zend license and are unable to  |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@zend.com so we can mail you a copy immediately.              |
+   +----------------------------------------------------------------------+
+*/
+
+#include "hphp/runtime/base/sharded_shared_store.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+ShardedSharedStore::ShardedSharedStore(int id, int shards,
+                                       int64_t capacity /* = 0 */)
+  : SharedStore(id) {
+  assert(shards > 0);
+  m_shards.reserve(shards);
+  for (int i = 0; i < shards; i++) {
+    m_shards.push_back(new ConcurrentTableSharedStore(id, capacity / shards));
+  }
+}
+
+ShardedSharedStore::~ShardedSharedStore() {
+  for (auto shard : m_shards) {
+    delete shard;
+  }
+}
+
+bool ShardedSharedStore::clear() {
+  bool ret = true;
+  for (auto shard : m_shards) {
+    ret = shard->clear() && ret;
+  }
+  return ret;
+}
+
+int ShardedSharedStore::size() {
+  int ret = 0;
+  for (auto shard : m_shards) {
+    ret += shard->size();
+  }
+  return ret;
+}
+
+bool ShardedSharedStore::eraseImpl(CStrRef key, bool expired) {
+  return shardFor(key).eraseImpl(key, expired);
+}
+
+bool ShardedSharedStore::get(CStrRef key, Variant &value) {
+  return shardFor(key).get(key, value);
+}
+
+bool ShardedSharedStore::store(CStrRef key, CVarRef val, int64_t ttl,
+                               bool overwrite /* = true */) {
+  return shardFor(key).store(key, val, ttl, overwrite);
+}
+
+int64_t ShardedSharedStore::inc(CStrRef key, int64_t step, bool &found) {
+  return shardFor(key).inc(key, step, found);
+}
+
+bool ShardedSharedStore::cas(CStrRef key, int64_t old, int64_t val) {
+  return shardFor(key).cas(key, old, val);
+}
+
+bool ShardedSharedStore::exists(CStrRef key) {
+  return shardFor(key).exists(key);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// priming
+
+void ShardedSharedStore::prime(const std::vector<KeyValuePair> &vars) {
+  std::vector<std::vector<KeyValuePair> > parts(m_shards.size());
+  for (unsigned int i = 0; i < vars.size(); i++) {
+    const KeyValuePair &item = vars[i];
+    parts[shardIndex(hash_string(item.key, item.len))].push_back(item);
+  }
+  for (unsigned int i = 0; i < m_shards.size(); i++) {
+    if (!parts[i].empty()) {
+      m_shards[i]->prime(parts[i]);
+    }
+  }
+}
+
+// Constructing a primed value doesn't touch the table, any shard will do.
+bool ShardedSharedStore::constructPrime(CStrRef v, KeyValuePair& item,
+                                        bool serialized) {
+  return m_shards[0]->constructPrime(v, item, serialized);
+}
+
+bool ShardedSharedStore::constructPrime(CVarRef v, KeyValuePair& item) {
+  return m_shards[0]->constructPrime(v, item);
+}
+
+void ShardedSharedStore::primeDone() {
+  // the file storage is shared, it only needs to be sealed once
+  m_shards[0]->primeFileStorageDone();
+  for (std::set<std::string>::const_iterator iter =
+         RuntimeOption::ApcCompletionKeys.begin();
+       iter != RuntimeOption::ApcCompletionKeys.end(); ++iter) {
+    shardFor(iter->data(), iter->size()).primeCompletionKey(*iter);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// snapshots
+
+int64_t ShardedSharedStore::writeSnapshot(FILE* f, int waitSeconds,
+                                          int64_t& skipped) {
+  // Lock every shard up front so the wait is only paid once.
+  if (RuntimeOption::ApcConcurrentTableLockFree) {
+    for (auto shard : m_shards) {
+      shard->startLocking();
+    }
+    ConcurrentTableSharedStore::WaitForLockFreeOps(waitSeconds);
+  }
+  int64_t count = 0;
+  for (auto shard : m_shards) {
+    // Each shard stops locking once it has been written; after a failure
+    // the remaining ones are released here.
+    int64_t n = count < 0 ? -1 : shard->writeSnapshot(f, 0, skipped);
+    if (n < 0) {
+      count = -1;
+      shard->stopLocking();
+    } else {
+      count += n;
+    }
+  }
+  return count;
+}
+
+void ShardedSharedStore::loadSnapshotEntry(const char* key, int keyLen,
+                                           char* sAddr, int32_t sSize,
+                                           int64_t expiry) {
+  shardFor(key, keyLen).loadSnapshotEntry(key, keyLen, sAddr, sSize, expiry);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// debug support
+
+void ShardedSharedStore::dump(std::ostream & out, bool keyOnly,
+                              int waitSeconds) {
+  // Lock every shard up front so the wait is only paid once.
+  if (RuntimeOption::ApcConcurrentTableLockFree) {
+    for (auto shard : m_shards) {
+      shard->startLocking();
+    }
+    ConcurrentTableSharedStore::WaitForLockFreeOps(waitSeconds);
+  }
+  out << "Total " << size() << std::endl;
+  for (auto shard : m_shards) {
+    shard->dumpEntries(out, keyOnly);
+    shard->stopLocking();
+  }
+}
+
+void ShardedSharedStore::dumpCapacity(std::ostream & out) {
+  int64_t capacity = 0, bytes = 0, evictions = 0, evictedBytes = 0;
+  for (auto shard : m_shards) {
+    capacity += shard->getCapacity();
+    bytes += shard->getBytes();
+    evictions += shard->getEvictions();
+    evictedBytes += shard->getEvictedBytes();
+  }
+  out << "shards: " << m_shards.size() << std::endl;
+  out << "entries: " << size() << std::endl;
+  out << "capacity: " << capacity << std::endl;
+  out << "bytes: " << bytes << std::endl;
+  out << "evictions: " << evictions << std::endl;
+  out << "evicted-bytes: " << evictedBytes << std::endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,91 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   | Copyright (c) 1998-2010 Zend Technologies Ltd. (http://www.zend.com) |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 2.00 of the Zend license,     |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.zend.com/license/2_00.txt.                                |
+   | If you did not receive a copy of the Zend license and are unable to  |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@zend.com so we can mail you a copy immediately.              |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef incl_HPHP_SHARDED_SHARED_STORE_H_
+#define incl_HPHP_SHARDED_SHARED_STORE_H_
+
+#include "hphp/runtime/base/concurrent_shared_store.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+// ShardedSharedStore
+
+/*
+ * A store made of several independent ConcurrentTableSharedStores, with
+ * keys routed to a shard by hash. Table-wide operations (dump, eviction,
+ * purging) only ever lock one shard, so they stall a fraction of the
+ * requests they would with a single table. The memory limit, if any, is
+ * split evenly between the shards.
+ */
+class ShardedSharedStore : public SharedStore {
+public:
+  ShardedSharedStore(int id, int shards, int64_t capacity = 0);
+  virtual ~ShardedSharedStore();
+
+  virtual int size();
+  virtual bool get(CStrRef key, Variant &value);
+  virtual bool store(CStrRef key, CVarRef val, int64_t ttl,
+                     bool overwrite = true);
+  virtual int64_t inc(CStrRef key, int64_t step, bool &found);
+  virtual bool cas(CStrRef key, int64_t old, int64_t val);
+  virtual bool exists(CStrRef key);
+
+  virtual void prime(const std::vector<SharedStore::KeyValuePair> &vars);
+  virtual bool constructPrime(CStrRef v, KeyValuePair& item,
+                              bool serialized);
+  virtual bool constructPrime(CVarRef v, KeyValuePair& item);
+  virtual void primeDone();
+
+  // debug support
+  virtual void dump(std::ostream & out, bool keyOnly, int waitSeconds);
+  virtual void dumpCapacity(std::ostream & out);
+
+protected:
+  virtual SharedVariant* construct(CVarRef v) {
+    return new SharedVariant(v, false);
+  }
+
+  virtual bool clear();
+
+  virtual bool eraseImpl(CStrRef key, bool expired);
+
+  virtual int64_t writeSnapshot(FILE* f, int waitSeconds,
+                                int64_t& skipped);
+  virtual void loadSnapshotEntry(const char* key, int keyLen, char* sAddr,
+                                 int32_t sSize, int64_t expiry);
+
+private:
+  // The shards hash keys with the same function, and tbb picks buckets from
+  // the low bits, so route on the high bits to keep each shard's buckets
+  // evenly used.
+  size_t shardIndex(strhash_t h) const {
+    return (uint32_t(h) >> 16) % m_shards.size();
+  }
+  ConcurrentTableSharedStore& shardFor(const char* key, int len) {
+    return *m_shards[shardIndex(hash_string(key, len))];
+  }
+  ConcurrentTableSharedStore& shardFor(CStrRef key) {
+    return *m_shards[shardIndex(key->hash())];
+  }
+
+  std::vector<ConcurrentTableSharedStore*> m_shards;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif /* incl_HPHP_SHARDED_SHARED_STORE_H_ */
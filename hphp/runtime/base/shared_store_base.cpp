@@ -23,9 +23,15 @@
 #include "hphp/runtime/base/leak_detectable.h"
 #include "hphp/runtime/server/server_stats.h"
 #include "hphp/runtime/base/concurrent_shared_store.h"
+#include "hphp/runtime/base/sharded_shared_store.h"
 #include "hphp/util/timer.h"
 #include "hphp/util/logger.h"
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdio>
 
 #if !defined(HAVE_POSIX_FALLOCATE) && \
   (_XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L)
@@ -37,10 +43,14 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 // SharedStore
 
-SharedStore::SharedStore(int id) : m_id(id) {
+SharedStore::SharedStore(int id)
+  : m_id(id), m_snapshot(nullptr), m_snapshotSize(0) {
 }
 
 SharedStore::~SharedStore() {
+  if (m_snapshot) {
+    munmap(m_snapshot, m_snapshotSize);
+  }
 }
 
 std::string SharedStore::GetSkeleton(CStrRef key) {
@@ -72,6 +82,145 @@ bool SharedStore::erase(CStrRef key, bool expired /* = false */) {
   return success;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// snapshots
+
+static const char s_snapshotMagic[8] = {'H','H','A','P','C','S','N','P'};
+static const uint32_t kSnapshotVersion = 1;
+
+static size_t snapshot_record_size(int32_t keyLen, int32_t sSize) {
+  size_t size = sizeof(SharedStore::SnapshotRecord) + keyLen + 1 +
+                abs(sSize) + 1;
+  return (size + 7) & ~size_t(7);
+}
+
+bool SharedStore::WriteSnapshotRecord(FILE* f, const char* key,
+                                      int32_t keyLen, const char* data,
+                                      int32_t sSize, int64_t expiry) {
+  static const char zeros[8] = {0};
+  SnapshotRecord rec;
+  rec.keyLen = keyLen;
+  rec.sSize = sSize;
+  rec.expiry = expiry;
+  size_t len = abs(sSize);
+  size_t written = sizeof(rec) + keyLen + 1 + len + 1;
+  size_t pad = snapshot_record_size(keyLen, sSize) - written;
+  return fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+         fwrite(key, 1, keyLen + 1, f) == size_t(keyLen + 1) &&
+         fwrite(data, 1, len, f) == len &&
+         fwrite(zeros, 1, pad + 1, f) == pad + 1;
+}
+
+bool SharedStore::saveSnapshot(const std::string& path,
+                               int waitSeconds /* = 0 */) {
+  Timer timer(Timer::WallTime, "saving apc snapshot");
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) {
+    Logger::Error("Failed to open apc snapshot %s: %s", tmp.c_str(),
+                  strerror(errno));
+    return false;
+  }
+  SnapshotHeader header;
+  memcpy(header.magic, s_snapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.pad = 0;
+  header.count = 0;
+  int64_t count = -1, skipped = 0;
+  if (fwrite(&header, sizeof(header), 1, f) == 1) {
+    count = writeSnapshot(f, waitSeconds, skipped);
+  }
+  if (count >= 0) {
+    header.count = count;
+    if (fseek(f, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, f) != 1) {
+      count = -1;
+    }
+  }
+  if (fclose(f) != 0) count = -1;
+  // rename so that a crash never leaves a truncated snapshot behind
+  if (count < 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+    Logger::Error("Failed to write apc snapshot %s", path.c_str());
+    unlink(tmp.c_str());
+    return false;
+  }
+  Logger::Info("saved %" PRId64 " apc entries to %s", count, path.c_str());
+  if (skipped) {
+    Logger::Warning("apc snapshot %s is missing %" PRId64 " objects that "
+                    "were already converted from their serialized form",
+                    path.c_str(), skipped);
+  }
+  return true;
+}
+
+bool SharedStore::loadSnapshot(const std::string& path) {
+  if (m_snapshot) return false;
+  Timer timer(Timer::WallTime, "loading apc snapshot");
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      Logger::Error("Failed to open apc snapshot %s: %s", path.c_str(),
+                    strerror(errno));
+    }
+    return false;
+  }
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SnapshotHeader)) {
+    addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (addr == MAP_FAILED) {
+    Logger::Error("Failed to map apc snapshot %s", path.c_str());
+    return false;
+  }
+
+  char* base = (char*)addr;
+  char* end = base + st.st_size;
+  const SnapshotHeader* header = (const SnapshotHeader*)base;
+  if (memcmp(header->magic, s_snapshotMagic, sizeof(header->magic)) ||
+      header->version != kSnapshotVersion) {
+    Logger::Error("Ignoring apc snapshot %s: bad header", path.c_str());
+    munmap(addr, st.st_size);
+    return false;
+  }
+  m_snapshot = addr;
+  m_snapshotSize = st.st_size;
+
+  time_t now = time(nullptr);
+  uint64_t loaded = 0;
+  char* current = base + sizeof(SnapshotHeader);
+  for (uint64_t i = 0; i < header->count; i++) {
+    if (end - current < (ptrdiff_t)sizeof(SnapshotRecord)) break;
+    const SnapshotRecord* rec = (const SnapshotRecord*)current;
+    if (rec->keyLen < 0 || rec->sSize == INT_MIN ||
+        (uint64_t)(end - current) < snapshot_record_size(rec->keyLen,
+                                                         rec->sSize)) {
+      Logger::Error("apc snapshot %s is truncated at record %" PRIu64,
+                    path.c_str(), i);
+      break;
+    }
+    char* key = current + sizeof(SnapshotRecord);
+    char* data = key + rec->keyLen + 1;
+    // The key and the data are each followed by a NUL that readers of the
+    // entry rely on; don't trust a file that lost them.
+    if (key[rec->keyLen] || data[abs(rec->sSize)]) {
+      Logger::Error("apc snapshot %s is corrupt at record %" PRIu64,
+                    path.c_str(), i);
+      break;
+    }
+    if (!rec->expiry || rec->expiry > now) {
+      loadSnapshotEntry(key, rec->keyLen, data, rec->sSize, rec->expiry);
+      loaded++;
+    }
+    current += snapshot_record_size(rec->keyLen, rec->sSize);
+  }
+  Logger::Info("loaded %" PRIu64 " apc entries from %s", loaded, path.c_str());
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 void StoreValue::set(SharedVariant *v, int64_t ttl) {
   var = v;
   expiry = ttl ? time(nullptr) + ttl : 0;
@@ -90,9 +239,16 @@ SharedStores::SharedStores() {
 
 void SharedStores::create() {
   for (int i = 0; i < MAX_SHARED_STORE; i++) {
+    // only the user visible cache is subject to the memory limit
+    int64_t capacity = i == SHARED_STORE_APPLICATION_CACHE ?
+      RuntimeOption::ApcMemoryLimit : 0;
     switch (RuntimeOption::ApcTableType) {
       case RuntimeOption::ApcTableTypes::ApcConcurrentTable:
-        m_stores[i] = new ConcurrentTableSharedStore(i);
+        m_stores[i] = new ConcurrentTableSharedStore(i, capacity);
+        break;
+      case RuntimeOption::ApcTableTypes::ApcShardedTable:
+        m_stores[i] = new ShardedSharedStore(i, RuntimeOption::ApcShardCount,
+                                             capacity);
         break;
       default:
         assert(false);
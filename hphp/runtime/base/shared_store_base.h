@@ -33,10 +33,13 @@ namespace HPHP {
 
 class StoreValue {
 public:
-  StoreValue() : var(nullptr), sAddr(nullptr), expiry(0), size(0), sSize(0) {}
+  StoreValue() : var(nullptr), sAddr(nullptr), expiry(0), size(0), sSize(0),
+                 atime(0), footprint(0), fromSnapshot(false) {}
   StoreValue(const StoreValue& v) : var(v.var), sAddr(v.sAddr),
                                     expiry(v.expiry), size(v.size),
-                                    sSize(v.sSize) {}
+                                    sSize(v.sSize), atime(v.atime),
+                                    footprint(v.footprint),
+                                    fromSnapshot(v.fromSnapshot) {}
   void set(SharedVariant *v, int64_t ttl);
   bool expired() const;
 
@@ -49,6 +52,13 @@ public:
   mutable int32_t size;
   int32_t sSize; // For file storage, negative means serailized object
   mutable SmallLock lock;
+  // Only maintained when the store has a memory limit: last access time
+  // for LRU eviction, and the bytes charged against the limit.
+  mutable uint32_t atime;
+  mutable int32_t footprint;
+  // The file copy came from a snapshot rather than priming, so unlike a
+  // primed value it is not restored when the in-memory value goes away.
+  bool fromSnapshot;
 
   bool inMem() const {
     return var != nullptr;
@@ -114,9 +124,52 @@ public:
     /* Default does nothing*/
   }
 
+  // memory limit and eviction counters, for the admin server
+  virtual void dumpCapacity(std::ostream & out) {
+    /* Default does nothing*/
+  }
+
+  /*
+   * Snapshots let a restarted server start with a warm cache. The file is a
+   * SnapshotHeader followed by one SnapshotRecord per key, each followed by
+   * the key, the APC-serialized value and their terminating '\0's, padded
+   * to 8 bytes. loadSnapshot() mmaps the file and only inserts keys that
+   * are not already there (so primed values win); values are unserialized
+   * from the mapping on first access, the same way primed file storage is.
+   */
+  bool saveSnapshot(const std::string& path, int waitSeconds = 0);
+  bool loadSnapshot(const std::string& path);
+
+  struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    uint64_t count;
+  };
+  struct SnapshotRecord {
+    int32_t keyLen;
+    int32_t sSize; // negative means serialized object, as in StoreValue
+    int64_t expiry;
+  };
+
 protected:
   int m_id;
 
+  // Writes the records of all live entries, returns how many or -1. Values
+  // that can't be saved are counted in skipped.
+  virtual int64_t writeSnapshot(FILE* f, int waitSeconds, int64_t& skipped) {
+    return 0;
+  }
+  virtual void loadSnapshotEntry(const char* key, int keyLen, char* sAddr,
+                                 int32_t sSize, int64_t expiry) {}
+  static bool WriteSnapshotRecord(FILE* f, const char* key, int32_t keyLen,
+                                  const char* data, int32_t sSize,
+                                  int64_t expiry);
+
+private:
+  void* m_snapshot;
+  size_t m_snapshotSize;
+
   virtual bool eraseImpl(CStrRef key, bool expired) = 0;
   virtual SharedVariant* construct(CVarRef v) = 0;
   virtual SharedVariant* putVar(SharedVariant* v) const { return v; };
@@ -97,6 +97,13 @@ public:
   SharedVariant *convertObj(CVarRef var);
   bool isUnserializedObj() { return getIsObj(); }
 
+  // The serialized form of an object that hasn't been converted by
+  // convertObj(); it can be saved without the class being defined.
+  StringData *getSerializedObj() {
+    assert(is(KindOfObject) && !isUnserializedObj());
+    return m_data.str;
+  }
+
 private:
   /*
    * Keep the object layout binary compatible with Variant for primitive types.
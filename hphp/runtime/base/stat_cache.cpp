@@ -20,10 +20,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/param.h>
 
 #include "hphp/util/trace.h"
 #include "hphp/util/logger.h"
+#include "hphp/util/async_func.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/vm/jit/hooks.h"
 
@@ -185,9 +187,10 @@ void StatCache::Node::touchLocked(bool invalidate /* = true */) {
     // node and/or remove paths.
     for (NameMap::const_iterator it = m_paths.begin(); it != m_paths.end();
          ++it) {
+      m_statCache.m_snapshot->noteInvalid(it->first);
       if (invalidate && m_valid) {
         TRACE(1, "StatCache: invalidate path '%s'\n", it->first.c_str());
-        HPHP::invalidatePath(it->first);
+        m_statCache.invalidatePath(it->first);
       }
       if (removePaths) {
         m_statCache.removePath(it->first, this);
@@ -195,12 +198,13 @@ void StatCache::Node::touchLocked(bool invalidate /* = true */) {
     }
     for (NameMap::const_iterator it = m_lpaths.begin(); it != m_lpaths.end();
          ++it) {
+      m_statCache.m_snapshot->noteInvalid(it->first);
       if (invalidate && m_valid) {
         // Avoid duplicate invalidations.
         NameMap::const_iterator it2 = m_paths.find(it->first);
         if (it2 == m_paths.end()) {
           TRACE(1, "StatCache: invalidate link path '%s'\n", it->first.c_str());
-          HPHP::invalidatePath(it->first);
+          m_statCache.invalidatePath(it->first);
         }
       }
       if (removePaths) {
@@ -409,16 +413,196 @@ StatCache::NodePtr StatCache::Node::getChild(const std::string& childName,
   return child;
 }
 
+//==============================================================================
+// StatCache::Snapshot.
+
+namespace {
+
+/*
+ * Just enough RCU for the snapshot: a reader publishes the epoch it
+ * entered at for the length of a lookup, and a writer that has replaced a
+ * shard waits until no reader is still in an epoch from before the
+ * replacement before it frees the old one.
+ */
+struct ReaderEpoch {
+  ReaderEpoch() : epoch(0), next(nullptr) {}
+  std::atomic<uint64_t> epoch; // 0 outside a read section.
+  ReaderEpoch* next;
+};
+
+std::atomic<uint64_t> s_epoch(1);
+std::atomic<ReaderEpoch*> s_readers(nullptr);
+__thread ReaderEpoch* t_reader;
+
+class ReadSection {
+ public:
+  ReadSection() {
+    m_reader = t_reader;
+    if (UNLIKELY(!m_reader)) {
+      // Never freed; the list only grows by one entry per thread.
+      m_reader = t_reader = new ReaderEpoch;
+      ReaderEpoch* head = s_readers.load(std::memory_order_relaxed);
+      do {
+        m_reader->next = head;
+      } while (!s_readers.compare_exchange_weak(head, m_reader));
+    }
+    m_reader->epoch.store(s_epoch.load());
+  }
+  ~ReadSection() {
+    m_reader->epoch.store(0, std::memory_order_release);
+  }
+
+ private:
+  ReaderEpoch* m_reader;
+};
+
+void synchronizeReaders() {
+  uint64_t epoch = s_epoch.fetch_add(1) + 1;
+  for (ReaderEpoch* r = s_readers.load(); r; r = r->next) {
+    while (true) {
+      uint64_t e = r->epoch.load();
+      if (e == 0 || e >= epoch) break;
+      usleep(100);
+    }
+  }
+}
+
+}
+
+class StatCache::Snapshot {
+ public:
+  Snapshot() : m_lock(false /*reentrant*/, RankLeaf), m_clear(false) {
+    for (uint32_t i = 0; i < kNumShards; ++i) {
+      m_shards[i].store(new Shard);
+    }
+  }
+
+  bool lookup(const std::string& path, bool follow, struct stat* buf) {
+    ReadSection section;
+    const Shard* shard = m_shards[shardFor(path)].load();
+    Shard::const_iterator it = shard->find(path);
+    if (it == shard->end()) return false;
+    const Entry& e = it->second;
+    if (!(follow ? e.hasStat : e.hasLstat)) return false;
+    memcpy(buf, follow ? &e.stat : &e.lstat, sizeof(struct stat));
+    return true;
+  }
+
+  // Called by a reader that had to go to the tree for path, so the next
+  // update() adds it.
+  void noteMiss(const std::string& path, bool follow) {
+    SimpleLock lock(m_lock);
+    m_misses.push_back(std::make_pair(path, follow));
+  }
+
+  void noteInvalid(const std::string& path) {
+    SimpleLock lock(m_lock);
+    m_invalid.push_back(path);
+  }
+
+  void noteClear() {
+    SimpleLock lock(m_lock);
+    m_clear = true;
+  }
+
+  // Called by the refresh thread, after it applied a batch of events to
+  // the tree and released its locks.
+  void update(StatCache& sc) {
+    std::vector<std::pair<std::string, bool> > misses;
+    std::vector<std::string> invalid;
+    bool clear;
+    {
+      SimpleLock lock(m_lock);
+      misses.swap(m_misses);
+      invalid.swap(m_invalid);
+      clear = m_clear;
+      m_clear = false;
+    }
+    if (misses.empty() && invalid.empty() && !clear) return;
+
+    Shard* shards[kNumShards] = {};
+    auto copyOf = [&] (uint32_t i) -> Shard& {
+      if (!shards[i]) {
+        shards[i] = clear ? new Shard : new Shard(*m_shards[i].load());
+      }
+      return *shards[i];
+    };
+    if (clear) {
+      for (uint32_t i = 0; i < kNumShards; ++i) copyOf(i);
+    }
+    for (auto& path : invalid) {
+      copyOf(shardFor(path)).erase(path);
+    }
+    // Look the misses up again rather than trusting what the reader saw:
+    // the tree now reflects every event read so far. A path that is not in
+    // the tree (inotify is unavailable, or it was just reset) has nothing
+    // watching it, so it stays out of the snapshot too.
+    for (auto& miss : misses) {
+      {
+        NameNodeMap& p2n = miss.second ? sc.m_path2Node : sc.m_lpath2Node;
+        NameNodeMap::const_accessor acc;
+        if (!p2n.find(acc, miss.first)) continue;
+      }
+      Shard& shard = copyOf(shardFor(miss.first));
+      Entry& e = shard[miss.first];
+      if (miss.second) {
+        e.hasStat = sc.statSlow(miss.first, &e.stat) == 0;
+      } else {
+        e.hasLstat = sc.lstatSlow(miss.first, &e.lstat) == 0;
+      }
+      if (!e.hasStat && !e.hasLstat) shard.erase(miss.first);
+    }
+
+    std::vector<const Shard*> old;
+    for (uint32_t i = 0; i < kNumShards; ++i) {
+      if (shards[i]) old.push_back(m_shards[i].exchange(shards[i]));
+    }
+    synchronizeReaders();
+    for (auto shard : old) delete shard;
+  }
+
+ private:
+  static const uint32_t kNumShards = 64;
+
+  struct Entry {
+    Entry() : hasStat(false), hasLstat(false) {}
+    bool hasStat;
+    bool hasLstat;
+    struct stat stat;
+    struct stat lstat;
+  };
+  typedef hphp_hash_map<std::string, Entry, string_hash> Shard;
+
+  static uint32_t shardFor(const std::string& path) {
+    return hash_string(path.data(), path.size()) & (kNumShards - 1);
+  }
+
+  std::atomic<const Shard*> m_shards[kNumShards];
+
+  SimpleMutex m_lock; // Protects the following fields.
+  std::vector<std::pair<std::string, bool> > m_misses;
+  std::vector<std::string> m_invalid;
+  bool m_clear;
+};
+
 //==============================================================================
 // StatCache.
 
 StatCache::StatCache()
   : m_lock(false /*reentrant*/, RankStatCache), m_ifd(-1),
-    m_lastRefresh(time(nullptr)) {
+    m_lastRefresh(time(nullptr)), m_snapshot(new Snapshot),
+    m_refreshThread(nullptr), m_stop(false),
+    m_invalidLock(false /*reentrant*/, RankLeaf), m_hasInvalidPaths(false) {
 }
 
 StatCache::~StatCache() {
+  if (m_refreshThread) {
+    m_stop.store(true);
+    m_refreshThread->waitForEnd();
+    delete m_refreshThread;
+  }
   clear();
+  delete m_snapshot;
 }
 
 bool StatCache::init() {
@@ -432,6 +616,11 @@ bool StatCache::init() {
     clear();
     return true;
   }
+  if (!m_refreshThread) {
+    m_refreshThread = new AsyncFunc<StatCache>(this, &StatCache::refreshLoop);
+    m_refreshThread->setNoInit();
+    m_refreshThread->start();
+  }
   return false;
 #else
   return true;
@@ -547,6 +736,7 @@ bool StatCache::handleEvent(const struct inotify_event* event) {
     // The event queue overflowed, so all bets are off.  Start over.
     TRACE(0, "StatCache: event queue overflowed\n");
     reset();
+    m_snapshot->noteClear();
     return true;
   }
   assert(event->wd != -1);
@@ -667,6 +857,54 @@ void StatCache::refresh() {
 #endif
 }
 
+void StatCache::refreshLoop() {
+#ifdef __linux__
+  while (!m_stop.load()) {
+    int fd;
+    {
+      SimpleLock lock(m_lock);
+      fd = m_ifd;
+    }
+    if (fd == -1) {
+      usleep(50000);
+      continue;
+    }
+    // Only this thread closes m_ifd once it is open (see handleEvent()),
+    // so fd stays valid while we wait on it.
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 50) > 0) {
+      // Give the rest of a batch of changes a moment to arrive, so that
+      // it is applied, and the snapshot copied, once.
+      usleep(10000);
+    }
+    refresh();
+    m_snapshot->update(*this);
+  }
+#endif
+}
+
+void StatCache::invalidatePath(const std::string& path) {
+  SimpleLock lock(m_invalidLock);
+  m_invalidPaths.push_back(path);
+  m_hasInvalidPaths.store(true, std::memory_order_release);
+}
+
+void StatCache::drainInvalidPaths() {
+  if (!m_hasInvalidPaths.load(std::memory_order_acquire)) return;
+  std::vector<std::string> paths;
+  {
+    SimpleLock lock(m_invalidLock);
+    paths.swap(m_invalidPaths);
+    m_hasInvalidPaths.store(false, std::memory_order_relaxed);
+  }
+  for (auto& path : paths) {
+    HPHP::invalidatePath(path);
+  }
+}
+
 time_t StatCache::lastRefresh() {
   SimpleLock lock(m_lock);
 
@@ -679,6 +917,17 @@ int StatCache::statImpl(const std::string& path, struct stat* buf) {
     return statSyscall(path, buf);
   }
 
+  if (m_snapshot->lookup(path, true, buf)) {
+    return 0;
+  }
+  int ret = statSlow(path, buf);
+  if (ret == 0) {
+    m_snapshot->noteMiss(path, true);
+  }
+  return ret;
+}
+
+int StatCache::statSlow(const std::string& path, struct stat* buf) {
   {
     NameNodeMap::const_accessor acc;
     if (m_path2Node.find(acc, path)) {
@@ -706,6 +955,17 @@ int StatCache::lstatImpl(const std::string& path, struct stat* buf) {
     return statSyscall(path, buf);
   }
 
+  if (m_snapshot->lookup(path, false, buf)) {
+    return 0;
+  }
+  int ret = lstatSlow(path, buf);
+  if (ret == 0) {
+    m_snapshot->noteMiss(path, false);
+  }
+  return ret;
+}
+
+int StatCache::lstatSlow(const std::string& path, struct stat* buf) {
   {
     NameNodeMap::const_accessor acc;
     if (m_lpath2Node.find(acc, path)) {
@@ -892,7 +1152,7 @@ StatCache StatCache::s_sc;
 
 void StatCache::requestInit() {
   if (!RuntimeOption::ServerStatCache) return;
-  s_sc.refresh();
+  s_sc.drainInvalidPaths();
 }
 
 int StatCache::stat(const std::string& path, struct stat* buf) {
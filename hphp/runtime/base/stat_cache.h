@@ -22,6 +22,9 @@
 #include <sys/inotify.h>
 #endif
 
+#include <atomic>
+#include <vector>
+
 #include "tbb/concurrent_hash_map.h"
 
 #include "hphp/util/base.h"
@@ -31,9 +34,24 @@
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+template<class T> class AsyncFunc;
+
+/*
+ * Caches stat(), lstat() and readlink() results for absolute paths, and
+ * keeps them up to date with inotify watches on every directory along
+ * those paths.
+ *
+ * The results are kept in a tree of Nodes that mirrors the directories.
+ * Lookups of paths seen before are served from a Snapshot instead, which
+ * takes no locks. A refresh thread reads the inotify events, waits a
+ * moment for the rest of a batch (a checkout touches many files at once),
+ * applies them all to the tree, and then publishes new Snapshot shards
+ * without the invalidated paths and with the paths looked up since.
+ */
 class StatCache {
  public:
   struct Node;
+  class Snapshot;
   typedef AtomicSmartPtr<Node> NodePtr;
   typedef tbb::concurrent_hash_map<std::string, NodePtr,
                                    stringHashCompare> NameNodeMap;
@@ -92,7 +110,9 @@ class StatCache {
   StatCache();
   ~StatCache();
 
-  static void requestInit(); // Process pending file change notifications.
+  // Hand the paths the refresh thread saw change to the VM, which drops
+  // their units and translations during this request's init.
+  static void requestInit();
   static int stat(const std::string& path, struct stat* buf);
   static int lstat(const std::string& path, struct stat* buf);
   static std::string readlink(const std::string& path);
@@ -111,9 +131,14 @@ class StatCache {
   void removePath(const std::string& path, Node* node);
   void removeLPath(const std::string& path, Node* node);
   void refresh();
+  void refreshLoop();
+  void invalidatePath(const std::string& path);
+  void drainInvalidPaths();
   time_t lastRefresh();
   int statImpl(const std::string& path, struct stat* buf);
   int lstatImpl(const std::string& path, struct stat* buf);
+  int statSlow(const std::string& path, struct stat* buf);
+  int lstatSlow(const std::string& path, struct stat* buf);
   std::string readlinkImpl(const std::string& path);
   std::string realpathImpl(const char* path);
 
@@ -132,6 +157,14 @@ class StatCache {
   time_t m_lastRefresh; // Used for debugging.
   WatchNodeMap m_watch2Node;
   NodePtr m_root;
+
+  Snapshot* m_snapshot;
+  AsyncFunc<StatCache>* m_refreshThread;
+  std::atomic<bool> m_stop;
+
+  SimpleMutex m_invalidLock; // Protects m_invalidPaths.
+  std::atomic<bool> m_hasInvalidPaths;
+  std::vector<std::string> m_invalidPaths;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
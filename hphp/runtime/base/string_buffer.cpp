@@ -225,6 +225,21 @@ void StringBuffer::appendHelper(const char *s, int len) {
   (((us & 0xf) << 12)      | (((us >> 4) & 0xf) << 8) |   \
   (((us >> 8) & 0xf) << 4) | ((us >> 12) & 0xf))          \
 
+namespace {
+/*
+ * Characters appendJsonEscape() copies through unchanged under any options.
+ */
+struct JsonPlainChars {
+  JsonPlainChars() {
+    for (int c = 0; c < 128; c++) {
+      plain[c] = c >= ' ' && !strchr("\"\\/<>&'@%", c);
+    }
+  }
+  bool plain[128];
+};
+const JsonPlainChars s_jsonPlainChars;
+}
+
 void StringBuffer::appendJsonEscape(const char *s, int len, int options) {
   if (len == 0) {
     append("\"\"", 2);
@@ -236,6 +251,10 @@ void StringBuffer::appendJsonEscape(const char *s, int len, int options) {
 
     UTF8To16Decoder decoder(s, len, options & k_JSON_FB_LOOSE);
     for (;;) {
+      const char *run;
+      if (int n = decoder.decodeAsciiRun(s_jsonPlainChars.plain, run)) {
+        append(run, n);
+      }
       int c = decoder.decode();
       if (c == UTF8_END) {
         append('"');
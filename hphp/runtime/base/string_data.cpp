@@ -49,7 +49,57 @@ struct ahm_string_data_same {
 typedef folly::AtomicHashMap<const StringData *, uint32_t,
                              string_data_hash,
                              ahm_string_data_same> StringDataMap;
-static StringDataMap *s_stringDataMap;
+
+/*
+ * The static string table, split by hash into shards. An AtomicHashMap
+ * never rehashes; once it outgrows the size it was created with it chains
+ * another map behind the first, and every miss probes all of them. With
+ * shards only the shard that overflowed pays for that, and the lookups
+ * that hit the same cache lines are spread out when many threads intern
+ * strings at once.
+ */
+class StaticStringTable {
+public:
+  static const uint32_t kNumShards = 16;
+
+  explicit StaticStringTable(size_t size) {
+    StringDataMap::Config config;
+    config.growthFactor = 1;
+    // Shards fill up unevenly, so leave each some slack.
+    size_t shardSize = size / kNumShards + size / (kNumShards * 8) + 64;
+    for (uint32_t i = 0; i < kNumShards; i++) {
+      m_shards[i] = new StringDataMap(shardSize, config);
+    }
+  }
+
+  StringDataMap& shard(const StringData* sd) {
+    // The low bits pick the slot inside the shard.
+    return *m_shards[(uint32_t(sd->hash()) >> 24) & (kNumShards - 1)];
+  }
+
+  StringDataMap& shard(uint32_t i) { return *m_shards[i]; }
+
+  size_t size() const {
+    size_t n = 0;
+    for (uint32_t i = 0; i < kNumShards; i++) {
+      n += m_shards[i]->size();
+    }
+    return n;
+  }
+
+private:
+  StringDataMap* m_shards[kNumShards];
+};
+
+static StaticStringTable *s_stringDataMap;
+
+static StaticStringTable& staticStringTable() {
+  if (UNLIKELY(!s_stringDataMap)) {
+    s_stringDataMap =
+      new StaticStringTable(RuntimeOption::EvalInitialStaticStringTableSize);
+  }
+  return *s_stringDataMap;
+}
 
 const StringData* StringData::convert_double_helper(double n) {
  char *buf;
@@ -77,8 +127,9 @@ const StringData* StringData::convert_integer_helper(int64_t n) {
 #ifndef NDEBUG
 static bool checkStaticStr(const StringData* s) {
   assert(s->isStatic());
-  StringDataMap::const_iterator it = s_stringDataMap->find(s);
-  assert(it != s_stringDataMap->end());
+  StringDataMap& map = s_stringDataMap->shard(s);
+  StringDataMap::const_iterator it = map.find(s);
+  assert(it != map.end());
   assert(it->first == s);
   return true;
 }
@@ -89,20 +140,35 @@ size_t StringData::GetStaticStringCount() {
   return s_stringDataMap->size();
 }
 
-StringData *StringData::GetStaticString(const StringData *str) {
-  if (UNLIKELY(!s_stringDataMap)) {
-    StringDataMap::Config config;
-    config.growthFactor = 1;
-    s_stringDataMap =
-      new StringDataMap(RuntimeOption::EvalInitialStaticStringTableSize,
-                        config);
+void StringData::ReserveStaticStrings(size_t count) {
+  size_t size = GetStaticStringCount() + count;
+  if (size <= RuntimeOption::EvalInitialStaticStringTableSize) return;
+
+  // Move what is already there, with its constant handles, to a table
+  // big enough for everything. The old one can't be freed: nothing else
+  // is interning strings, but it is not worth proving nobody still holds
+  // an iterator into it.
+  StaticStringTable* table = new StaticStringTable(size);
+  if (s_stringDataMap) {
+    for (uint32_t i = 0; i < StaticStringTable::kNumShards; i++) {
+      StringDataMap& old = s_stringDataMap->shard(i);
+      for (StringDataMap::const_iterator it = old.begin();
+           it != old.end(); ++it) {
+        table->shard(it->first).insert(it->first, it->second);
+      }
+    }
   }
+  s_stringDataMap = table;
+}
+
+StringData *StringData::GetStaticString(const StringData *str) {
   if (str->isStatic()) {
     assert(checkStaticStr(str));
     return const_cast<StringData*>(str);
   }
-  StringDataMap::const_iterator it = s_stringDataMap->find(str);
-  if (it != s_stringDataMap->end()) {
+  StringDataMap& map = staticStringTable().shard(str);
+  StringDataMap::const_iterator it = map.find(str);
+  if (it != map.end()) {
     return const_cast<StringData*>(it->first);
   }
   // Lookup failed, so do the hard work of creating a StringData with its own
@@ -110,7 +176,7 @@ StringData *StringData::GetStaticString(const StringData *str) {
   StringData *sd = (StringData*)Util::low_malloc(sizeof(StringData));
   new (sd) StringData(str->data(), str->size(), CopyMalloc);
   sd->setStatic();
-  auto pair = s_stringDataMap->insert(sd, 0);
+  auto pair = map.insert(sd, 0);
   if (!pair.second) {
     sd->~StringData();
     Util::low_free(sd);
@@ -120,13 +186,14 @@ StringData *StringData::GetStaticString(const StringData *str) {
 }
 
 StringData *StringData::LookupStaticString(const StringData *str) {
-  if (UNLIKELY(!s_stringDataMap)) return nullptr;
   if (str->isStatic()) {
     assert(checkStaticStr(str));
     return const_cast<StringData*>(str);
   }
-  StringDataMap::const_iterator it = s_stringDataMap->find(str);
-  if (it != s_stringDataMap->end()) {
+  if (UNLIKELY(!s_stringDataMap)) return nullptr;
+  StringDataMap& map = s_stringDataMap->shard(str);
+  StringDataMap::const_iterator it = map.find(str);
+  if (it != map.end()) {
     return const_cast<StringData*>(it->first);
   }
   return nullptr;
@@ -152,8 +219,9 @@ StringData *StringData::GetStaticString(const char *str) {
 
 uint32_t StringData::GetCnsHandle(const StringData* cnsName) {
   assert(s_stringDataMap);
-  StringDataMap::const_iterator it = s_stringDataMap->find(cnsName);
-  if (it != s_stringDataMap->end()) {
+  StringDataMap& map = s_stringDataMap->shard(cnsName);
+  StringDataMap::const_iterator it = map.find(cnsName);
+  if (it != map.end()) {
     return it->second;
   }
   return 0;
@@ -168,8 +236,9 @@ uint32_t StringData::DefCnsHandle(const StringData* cnsName, bool persistent) {
     // the request local TargetCache::s_constants instead.
     return 0;
   }
-  StringDataMap::iterator it = s_stringDataMap->find(cnsName);
-  assert(it != s_stringDataMap->end());
+  StringDataMap& map = s_stringDataMap->shard(cnsName);
+  StringDataMap::iterator it = map.find(cnsName);
+  assert(it != map.end());
   if (!it->second) {
     Transl::TargetCache::allocConstant(&it->second, persistent);
   }
@@ -181,19 +250,22 @@ Array StringData::GetConstants() {
   assert(s_stringDataMap);
   Array a(Transl::TargetCache::s_constants);
 
-  for (StringDataMap::const_iterator it = s_stringDataMap->begin();
-       it != s_stringDataMap->end(); ++it) {
-    if (it->second) {
-      TypedValue& tv =
-        Transl::TargetCache::handleToRef<TypedValue>(it->second);
-      if (tv.m_type != KindOfUninit) {
-        StrNR key(const_cast<StringData*>(it->first));
-        a.set(key, tvAsVariant(&tv), true);
-      } else if (tv.m_data.pref) {
-        StrNR key(const_cast<StringData*>(it->first));
-        ClassInfo::ConstantInfo* ci =
-          (ClassInfo::ConstantInfo*)(void*)tv.m_data.pref;
-        a.set(key, ci->getDeferredValue(), true);
+  for (uint32_t i = 0; i < StaticStringTable::kNumShards; i++) {
+    StringDataMap& map = s_stringDataMap->shard(i);
+    for (StringDataMap::const_iterator it = map.begin();
+         it != map.end(); ++it) {
+      if (it->second) {
+        TypedValue& tv =
+          Transl::TargetCache::handleToRef<TypedValue>(it->second);
+        if (tv.m_type != KindOfUninit) {
+          StrNR key(const_cast<StringData*>(it->first));
+          a.set(key, tvAsVariant(&tv), true);
+        } else if (tv.m_data.pref) {
+          StrNR key(const_cast<StringData*>(it->first));
+          ClassInfo::ConstantInfo* ci =
+            (ClassInfo::ConstantInfo*)(void*)tv.m_data.pref;
+          a.set(key, ci->getDeferredValue(), true);
+        }
       }
     }
   }
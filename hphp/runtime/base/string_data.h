@@ -337,6 +337,10 @@ public:
    * and if so, return it. Else, return nullptr. */
   static StringData *LookupStaticString(const StringData* str);
   static size_t GetStaticStringCount();
+  /* Make room for count more static strings, so that interning them does
+   * not overflow the table. Only safe while no other thread is using the
+   * table, e.g. at startup. */
+  static void ReserveStaticStrings(size_t count);
   static uint32_t GetCnsHandle(const StringData* cnsName);
   static uint32_t DefCnsHandle(const StringData* cnsName, bool persistent);
   static Array GetConstants();
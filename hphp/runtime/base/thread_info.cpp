@@ -19,6 +19,7 @@
 #include "hphp/runtime/base/code_coverage.h"
 #include "hphp/runtime/base/smart_allocator.h"
 #include "hphp/runtime/vm/jit/target-cache.h"
+#include "hphp/runtime/vm/stack_sampler.h"
 #include "hphp/util/lock.h"
 #include "hphp/util/alloc.h"
 
@@ -63,6 +64,7 @@ ThreadInfo::ThreadInfo()
 
 ThreadInfo::~ThreadInfo() {
   t_stackbase = 0;
+  StackSampler::UnregisterThread();
 
   Lock lock(s_thread_info_mutex);
   s_thread_infos.erase(this);
@@ -123,6 +125,7 @@ void ThreadInfo::onSessionExit() {
 void RequestInjectionData::onSessionInit() {
   Transl::TargetCache::requestInit();
   cflagsPtr = Transl::TargetCache::conditionFlagsPtr();
+  StackSampler::RegisterThread(cflagsPtr);
   reset();
   started = time(0);
 }
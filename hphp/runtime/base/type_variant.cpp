@@ -1820,7 +1820,11 @@ void Variant::unserialize(VariableUnserializer *uns,
   case 's':
     {
       String v;
-      v.unserialize(uns);
+      if (mode == Uns::Mode::Key) {
+        uns->unserializeKeyString(v);
+      } else {
+        v.unserialize(uns);
+      }
       operator=(v);
     }
     break;
@@ -207,7 +207,10 @@ public:
   static const ssize_t InterceptFlag        = 1 << 5;
   // Set by the debugger to break out of loops in translated code.
   static const ssize_t DebuggerSignalFlag   = 1 << 6;
-  static const ssize_t LastFlag             = DebuggerSignalFlag;
+  // Set by StackSampler's SIGPROF handler; the next surprise check samples
+  // the PHP stack.
+  static const ssize_t ProfileSampleFlag    = 1 << 7;
+  static const ssize_t LastFlag             = ProfileSampleFlag;
 
   RequestInjectionData()
     : cflagsPtr(nullptr), surprisePage(nullptr), started(0), timeoutSeconds(-1),
@@ -384,6 +387,7 @@ extern ssize_t check_request_surprise(ThreadInfo *info) ATTRIBUTE_COLD;
 // implemented in runtime/ext/ext_hotprofiler.cpp
 extern void begin_profiler_frame(Profiler *p, const char *symbol);
 extern void end_profiler_frame(Profiler *p);
+extern void sample_profiler_stack(Profiler *p, const char *stack);
 
 ///////////////////////////////////////////////////////////////////////////////
 
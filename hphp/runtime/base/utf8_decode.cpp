@@ -193,5 +193,21 @@ int UTF8To16Decoder::decode() {
   }
 }
 
+int UTF8To16Decoder::decodeAsciiRun(const bool plain[128],
+                                    const char *&run) {
+  int start = m_decode.the_index;
+  run = m_decode.the_input + start;
+  if (m_low_surrogate) return 0;
+  int i = start;
+  while (i < m_decode.the_length) {
+    unsigned char c = m_decode.the_input[i];
+    if (c >= 128 || !plain[c]) break;
+    i++;
+  }
+  m_decode.the_char += i - start;
+  m_decode.the_index = i;
+  return i - start;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
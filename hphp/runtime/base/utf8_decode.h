@@ -38,6 +38,14 @@ public:
   UTF8To16Decoder(const char *utf8, int length, bool loose);
   int decode();
 
+  /*
+   * Consume the run of ASCII bytes at the current position that plain[]
+   * accepts, point run at it and return its length. Callers that would
+   * copy such characters through unchanged can take the whole run at once
+   * instead of decoding it a character at a time.
+   */
+  int decodeAsciiRun(const bool plain[128], const char *&run);
+
 private:
   json_utf8_decode m_decode;
   int m_loose; // Faceook: json_utf8_loose
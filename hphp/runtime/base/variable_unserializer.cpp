@@ -19,11 +19,18 @@
 #include "hphp/runtime/base/complex_types.h"
 #include "hphp/runtime/base/zend_strtod.h"
 #include "hphp/runtime/base/array_iterator.h"
+#include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/ext/ext_class.h"
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+VariableUnserializer::~VariableUnserializer() {
+  for (auto sd : m_keyCache) {
+    if (sd) decRefStr(sd);
+  }
+}
+
 Variant VariableUnserializer::unserialize() {
   Variant v;
   v.unserialize(this);
@@ -36,6 +43,55 @@ Variant VariableUnserializer::unserializeKey() {
   return v;
 }
 
+void VariableUnserializer::unserializeKeyString(String& out) {
+  int64_t size = readInt();
+  if (size >= RuntimeOption::MaxSerializedStringSize) {
+    throw Exception("Size of serialized string (%d) exceeds max", int(size));
+  }
+  if (size < 0) {
+    throw Exception("Size of serialized string (%d) must not be negative",
+                    int(size));
+  }
+  char ch = readChar();
+  if (ch != ':') {
+    throw Exception("Expected ':' but got '%c'", ch);
+  }
+  ch = readChar();
+  if (ch != '"') {
+    throw Exception("Expected '\"' but got '%c'", ch);
+  }
+
+  int len = std::min(size, int64_t(m_end - m_buf));
+  if (len == 0) {
+    out = empty_string;
+  } else if (len > kMaxCachedKeyLen) {
+    out = String(m_buf, len, CopyString);
+  } else {
+    // Cheap slot choice; a collision just costs a miss.
+    int slot = (len * 31 + (unsigned char)m_buf[0] * 7 +
+                (unsigned char)m_buf[len - 1]) & (kKeyCacheSize - 1);
+    StringData* sd = m_keyCache[slot];
+    if (sd && sd->size() == len && !memcmp(sd->data(), m_buf, len)) {
+      out = sd;
+    } else {
+      out = String(m_buf, len, CopyString);
+      if (StringData* st = StringData::LookupStaticString(out.get())) {
+        out = st;
+      }
+      if (sd) decRefStr(sd);
+      sd = out.get();
+      sd->incRefCount();
+      m_keyCache[slot] = sd;
+    }
+  }
+  m_buf += len;
+
+  ch = readChar();
+  if (ch != '"') {
+    throw Exception("Expected '\"' but got '%c'", ch);
+  }
+}
+
 int64_t VariableUnserializer::readInt() {
   check();
   char *newBuf;
@@ -45,13 +45,14 @@ public:
                        CArrRef class_whitelist = null_array)
       : m_type(type), m_buf(str), m_end(str + len),
         m_unknownSerializable(allowUnknownSerializableClass),
-        m_classWhiteList(class_whitelist) {}
+        m_classWhiteList(class_whitelist), m_keyCache() {}
   VariableUnserializer(const char *str, const char *end, Type type,
                        bool allowUnknownSerializableClass = false,
                        CArrRef class_whitelist = null_array)
       : m_type(type), m_buf(str), m_end(end),
         m_unknownSerializable(allowUnknownSerializableClass),
-        m_classWhiteList(class_whitelist) {}
+        m_classWhiteList(class_whitelist), m_keyCache() {}
+  ~VariableUnserializer();
 
   Type getType() const { return m_type;}
   bool allowUnknownSerializableClass() const { return m_unknownSerializable;}
@@ -59,6 +60,14 @@ public:
 
   Variant unserialize();
   Variant unserializeKey();
+  /*
+   * Read the body of an 's:' array key or property name. Payloads tend to
+   * repeat the same keys over and over (rows of the same array shape,
+   * objects of the same class), so recent keys are kept and handed out
+   * again instead of allocating, and later rehashing, a fresh string each
+   * time. Keys that already exist as static strings are replaced by those.
+   */
+  void unserializeKeyString(String& out);
   void add(Variant* v, Uns::Mode mode) {
     if (mode == Uns::Mode::Value) {
       m_refs.emplace_back(RefInfo(v));
@@ -137,6 +146,10 @@ public:
   bool m_unknownSerializable;
   CArrRef m_classWhiteList;    // classes allowed to be unserialized
 
+  static const int kKeyCacheSize = 32;  // must be a power of two
+  static const int kMaxCachedKeyLen = 64;
+  StringData* m_keyCache[kKeyCacheSize];
+
   void check() {
     if (m_buf >= m_end) {
       throw Exception("Unexpected end of buffer during unserialization");
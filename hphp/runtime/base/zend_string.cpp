@@ -23,6 +23,10 @@
 #include <math.h>
 #include <monetary.h>
 
+#ifdef __x86_64__
+#include <emmintrin.h>
+#endif
+
 #include "hphp/runtime/base/bstring.h"
 #include "hphp/runtime/base/exceptions.h"
 #include "hphp/runtime/base/complex_types.h"
@@ -286,11 +290,75 @@ int string_natural_cmp(char const *a, size_t a_len,
 
 ///////////////////////////////////////////////////////////////////////////////
 
+#ifdef __x86_64__
+/*
+ * SSE2 kernels for the hot loops below. x86-64 always has SSE2, so these
+ * need no cpuid check. Each one handles whole 16-byte blocks and leaves the
+ * ragged end, and anything unusual, to the scalar loop it replaces.
+ */
+namespace {
+
+inline __m128i ascii_range(__m128i v, char lo, char hi) {
+  // Only called on blocks with no byte >= 0x80, so signed compares are fine.
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+/*
+ * Case-fold 16 bytes of ASCII. Returns false, without writing anything, if
+ * the block has a byte >= 0x80; those go through tocase() so the current
+ * locale still decides what happens to them.
+ */
+inline bool ascii_to_case16(const char *src, char *dst, bool upper) {
+  __m128i v = _mm_loadu_si128((const __m128i*)src);
+  if (_mm_movemask_epi8(v)) return false;
+  __m128i bit = _mm_set1_epi8(0x20);
+  if (upper) {
+    v = _mm_xor_si128(v, _mm_and_si128(ascii_range(v, 'a', 'z'), bit));
+  } else {
+    v = _mm_or_si128(v, _mm_and_si128(ascii_range(v, 'A', 'Z'), bit));
+  }
+  _mm_storeu_si128((__m128i*)dst, v);
+  return true;
+}
+
+/*
+ * Bitmask of the bytes in src[0..15] that addslashes() has to escape.
+ */
+inline int addslashes_mask16(const char *src) {
+  __m128i v = _mm_loadu_si128((const __m128i*)src);
+  __m128i m = _mm_or_si128(
+    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\''))),
+    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+  return _mm_movemask_epi8(m);
+}
+
+}
+#endif
+
 char *string_to_case(const char *s, int len, int (*tocase)(int)) {
   assert(s);
   assert(tocase);
   char *ret = (char *)malloc(len + 1);
-  for (int i = 0; i < len; i++) {
+  int i = 0;
+#ifdef __x86_64__
+  // The ASCII fast path is only right for the plain ctype functions, and
+  // only in locales that fold ASCII the usual way (not, say, Turkish).
+  bool upper = tocase == (int (*)(int))toupper;
+  if ((upper || tocase == (int (*)(int))tolower) && len >= 16 &&
+      toupper('i') == 'I' && tolower('I') == 'i') {
+    for (; i + 16 <= len; i += 16) {
+      if (!ascii_to_case16(s + i, ret + i, upper)) {
+        for (int j = i; j < i + 16; j++) {
+          ret[j] = tocase(s[j]);
+        }
+      }
+    }
+  }
+#endif
+  for (; i < len; i++) {
     ret[i] = tocase(s[i]);
   }
   ret[len] = '\0';
@@ -535,6 +603,27 @@ const char *string_memnstr(const char *haystack, const char *needle,
   char ne = needle[needle_len-1];
 
   end -= needle_len;
+#ifdef __x86_64__
+  // Test 16 candidate starts at once against the needle's first and last
+  // bytes, and only memcmp the ones that match both.
+  if (needle_len > 1) {
+    __m128i first = _mm_set1_epi8(*needle);
+    __m128i last = _mm_set1_epi8(ne);
+    for (; p + 15 <= end; p += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i*)p);
+      __m128i b = _mm_loadu_si128((const __m128i*)(p + needle_len - 1));
+      int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                 _mm_cmpeq_epi8(b, last)));
+      while (mask) {
+        int i = __builtin_ctz(mask);
+        if (!memcmp(needle + 1, p + i + 1, needle_len - 2)) {
+          return p + i;
+        }
+        mask &= mask - 1;
+      }
+    }
+  }
+#endif
   while (p <= end) {
     if ((p = (char *)memchr(p, *needle, (end-p+1))) && ne == p[needle_len-1]) {
       if (!memcmp(needle, p, needle_len-1)) {
@@ -1312,6 +1401,23 @@ char *string_addslashes(const char *str, int &length) {
   char *target = new_str;
 
   while (source < end) {
+#ifdef __x86_64__
+    // Copy runs that need no escaping 16 bytes at a time.
+    if (end - source >= 16) {
+      int mask = addslashes_mask16(source);
+      if (!mask) {
+        _mm_storeu_si128((__m128i*)target,
+                         _mm_loadu_si128((const __m128i*)source));
+        source += 16;
+        target += 16;
+        continue;
+      }
+      int clean = __builtin_ctz(mask);
+      memcpy(target, source, clean);
+      source += clean;
+      target += clean;
+    }
+#endif
     switch (*source) {
     case '\0':
       *target++ = '\\';
@@ -497,6 +497,20 @@ static void attach_zval(json_parser *json, CStrRef key,
   }
 }
 
+/*
+ * Characters that leave a string body in state 3 and are copied into it
+ * unchanged, in both the strict and the loose grammar.
+ */
+struct JsonStringChars {
+  JsonStringChars() {
+    for (int c = 0; c < 128; c++) {
+      plain[c] = c >= ' ' && c != '"' && c != '\'' && c != '\\';
+    }
+  }
+  bool plain[128];
+};
+static const JsonStringChars s_jsonStringChars;
+
 #define SWAP_BUFFERS(from, to) do { \
     StringBuffer *tmp = from;       \
     from = to;                      \
@@ -543,6 +557,12 @@ bool JSON_parser(Variant &z, const char *p, int length, bool assoc/*<fb>*/,
 
   UTF8To16Decoder decoder(p, length, loose);
   for (;;) {
+    if (the_state == 3 && type == KindOfString) {
+      const char *run;
+      if (int n = decoder.decodeAsciiRun(s_jsonStringChars.plain, run)) {
+        buf->append(run, n);
+      }
+    }
     b = decoder.decode();
     if (b == UTF8_END) break; // UTF-8 decoding finishes successfully.
     if (b == UTF8_ERROR) {
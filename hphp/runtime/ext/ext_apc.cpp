@@ -1296,6 +1296,23 @@ String apc_reserialize(CStrRef str) {
   return buf.detach();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// snapshots
+
+void apc_load_snapshot() {
+  if (!RuntimeOption::EnableApc || RuntimeOption::ApcSnapshotFile.empty()) {
+    return;
+  }
+  s_apc_store[0].loadSnapshot(RuntimeOption::ApcSnapshotFile);
+}
+
+bool apc_save_snapshot(const char *filename, int waitSeconds /* = 0 */) {
+  if (!RuntimeOption::EnableApc) {
+    return false;
+  }
+  return s_apc_store[0].saveSnapshot(filename, waitSeconds);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // debugging support
 
@@ -62,6 +62,10 @@ bool f_apc_bin_loadfile(CStrRef filename,
 
 void apc_load(int thread);
 
+// warm restarts, see SharedStore::saveSnapshot()
+void apc_load_snapshot();
+bool apc_save_snapshot(const char *filename, int waitSeconds = 0);
+
 // needed by generated apc archive .cpp files
 void apc_load_impl(struct cache_info *info,
                    const char **int_keys, long long *int_values,
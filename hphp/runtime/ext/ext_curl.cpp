@@ -22,7 +22,15 @@
 #include "hphp/runtime/base/curl_tls_workarounds.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/server/server_stats.h"
+#include "hphp/runtime/ext/asio/asio_external_thread_event.h"
 #include "hphp/runtime/vm/jit/translator-inline.h"
+#include "hphp/system/systemlib.h"
+#include "hphp/util/async_func.h"
+#include "hphp/util/lock.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <map>
 
 #define CURLOPT_RETURNTRANSFER 19913
 #define CURLOPT_BINARYTRANSFER 19914
@@ -45,9 +53,12 @@ static StaticString s_previous("previous");
 ///////////////////////////////////////////////////////////////////////////////
 // helper data structure
 
+class CurlAsyncEvent;
+
 class CurlResource : public SweepableResourceData {
 private:
   DECLARE_OBJECT_ALLOCATION(CurlResource)
+  friend class CurlAsyncEvent;
 
   class WriteHandler {
   public:
@@ -248,7 +259,87 @@ public:
       check_exception();
     }
     set_curl_statuses(m_cp, m_url.data());
+    return getResult();
+  }
+
+  /**
+   * Whether curl_exec_async() can run this handle. The transfer runs on
+   * another thread, so curl must not be set up to call back into PHP or
+   * to read or write a PHP stream.
+   */
+  bool canExecuteAsync() const {
+    return m_cp &&
+      (m_write.method == PHP_CURL_STDOUT ||
+       m_write.method == PHP_CURL_RETURN) &&
+      (m_write_header.method == PHP_CURL_STDOUT ||
+       m_write_header.method == PHP_CURL_IGNORE) &&
+      m_read.method == PHP_CURL_DIRECT && m_read.fp.isNull();
+  }
+
+  /**
+   * Hand the easy handle over to an async transfer. Until finishAsync()
+   * gives it back the resource has no handle, so anything else done with
+   * it fails the way it would after curl_close().
+   */
+  CURL *detachForAsync(ToFreePtr &to_free) {
+    assert(canExecuteAsync());
+    if (m_emptyPost) {
+      curl_easy_setopt(m_cp, CURLOPT_POSTFIELDSIZE, 0);
+    }
+    m_write.buf.reset();
+    m_write.content.clear();
+    m_header.clear();
+    memset(m_error_str, 0, sizeof(m_error_str));
+
+    CURL *cp = m_cp;
+    m_cp = NULL;
+    to_free = m_to_free;
+    return cp;
+  }
+
+  bool headerOutEnabled() const {
+    return m_opts.exists(int64_t(CURLINFO_HEADER_OUT)) &&
+      m_opts[int64_t(CURLINFO_HEADER_OUT)].toInt64() == 1;
+  }
+
+  /**
+   * Take the handle back from a finished async transfer, and return what
+   * curl_exec() would have.
+   */
+  Variant finishAsync(CURL *cp, CURLcode error_no, const char *error_str,
+                      const std::string &output,
+                      const std::string &header_out) {
+    m_cp = cp;
+    curl_easy_setopt(m_cp, CURLOPT_ERRORBUFFER,       m_error_str);
+    curl_easy_setopt(m_cp, CURLOPT_WRITEFUNCTION,     curl_write);
+    curl_easy_setopt(m_cp, CURLOPT_FILE,              (void*)this);
+    curl_easy_setopt(m_cp, CURLOPT_READFUNCTION,      curl_read);
+    curl_easy_setopt(m_cp, CURLOPT_INFILE,            (void*)this);
+    curl_easy_setopt(m_cp, CURLOPT_HEADERFUNCTION,    curl_write_header);
+    curl_easy_setopt(m_cp, CURLOPT_WRITEHEADER,       (void*)this);
+    if (headerOutEnabled()) {
+      curl_easy_setopt(m_cp, CURLOPT_DEBUGFUNCTION, curl_debug);
+      curl_easy_setopt(m_cp, CURLOPT_DEBUGDATA, (void *)this);
+    }
+
+    m_error_no = error_no;
+    strncpy(m_error_str, error_str, CURL_ERROR_SIZE);
+    if (!header_out.empty()) {
+      m_header = String(header_out.data(), header_out.size(), CopyString);
+    }
+    set_curl_statuses(m_cp, m_url.data());
 
+    if (!output.empty()) {
+      if (m_write.method == PHP_CURL_RETURN) {
+        m_write.buf.append(output.data(), output.size());
+      } else {
+        g_context->write(output.data(), output.size());
+      }
+    }
+    return getResult();
+  }
+
+  Variant getResult() {
     /* CURLE_PARTIAL_FILE is returned by HEAD requests */
     if (m_error_no != CURLE_OK && m_error_no != CURLE_PARTIAL_FILE) {
       m_write.buf.reset();
@@ -826,6 +917,249 @@ Variant f_curl_exec(CResRef ch) {
   return curl->execute();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// transfers on the async event thread
+
+/**
+ * A curl_exec() run by CurlAsyncDriver. The easy handle is detached from
+ * its resource for the length of the transfer and pointed at buffers of
+ * this event; unserialize() gives it back and produces the return value
+ * on the request thread. The event keeps its own reference to the
+ * resource's post data and header lists, which curl reads during the
+ * transfer, in case the request goes away first.
+ */
+class CurlAsyncEvent : public AsioExternalThreadEvent {
+public:
+  explicit CurlAsyncEvent(CurlResource *curl)
+    : AsioExternalThreadEvent(curl), m_error_no(CURLE_OK) {
+    memset(m_error_str, 0, sizeof(m_error_str));
+    bool header_out = curl->headerOutEnabled();
+    bool header_stdout = curl->m_write_header.method == PHP_CURL_STDOUT;
+    m_cp = curl->detachForAsync(m_to_free);
+
+    curl_easy_setopt(m_cp, CURLOPT_ERRORBUFFER,       m_error_str);
+    curl_easy_setopt(m_cp, CURLOPT_WRITEFUNCTION,     write_output);
+    curl_easy_setopt(m_cp, CURLOPT_FILE,              (void*)this);
+    curl_easy_setopt(m_cp, CURLOPT_READFUNCTION,      read_nothing);
+    curl_easy_setopt(m_cp, CURLOPT_INFILE,            (void*)this);
+    curl_easy_setopt(m_cp, CURLOPT_HEADERFUNCTION,
+                     header_stdout ? write_output : ignore);
+    curl_easy_setopt(m_cp, CURLOPT_WRITEHEADER,       (void*)this);
+    if (header_out) {
+      curl_easy_setopt(m_cp, CURLOPT_DEBUGFUNCTION, debug);
+      curl_easy_setopt(m_cp, CURLOPT_DEBUGDATA, (void *)this);
+    }
+  }
+
+  ~CurlAsyncEvent() {
+    if (m_cp) curl_easy_cleanup(m_cp);
+  }
+
+  CURL *handle() const { return m_cp; }
+
+  /**
+   * Called on the event thread once the transfer is over.
+   */
+  void finish(CURLcode error_no) {
+    m_error_no = error_no;
+    markAsFinished();
+  }
+
+protected:
+  void unserialize(Cell& result) const {
+    CurlResource *curl = static_cast<CurlResource*>(getPrivData());
+    CURL *cp = m_cp;
+    m_cp = nullptr; // the resource owns it again
+    Variant ret = curl->finishAsync(cp, m_error_no, m_error_str, m_output,
+                                    m_header_out);
+    cellDup(*ret.asCell(), result);
+  }
+
+private:
+  static size_t write_output(char *data, size_t size, size_t nmemb,
+                             void *ctx) {
+    CurlAsyncEvent *event = (CurlAsyncEvent *)ctx;
+    event->m_output.append(data, size * nmemb);
+    return size * nmemb;
+  }
+
+  static size_t ignore(char *data, size_t size, size_t nmemb, void *ctx) {
+    return size * nmemb;
+  }
+
+  static size_t read_nothing(char *data, size_t size, size_t nmemb,
+                             void *ctx) {
+    return 0;
+  }
+
+  static int debug(CURL *cp, curl_infotype type, char *buf, size_t buf_len,
+                   void *ctx) {
+    CurlAsyncEvent *event = (CurlAsyncEvent *)ctx;
+    if (type == CURLINFO_HEADER_OUT && buf_len > 0) {
+      event->m_header_out.assign(buf, buf_len);
+    }
+    return 0;
+  }
+
+  mutable CURL *m_cp;
+  CurlResource::ToFreePtr m_to_free;
+  char m_error_str[CURL_ERROR_SIZE + 1];
+  CURLcode m_error_no;
+  std::string m_output;
+  std::string m_header_out;
+};
+
+/**
+ * One thread, started on first use, that runs every async transfer in the
+ * process on a single curl multi handle. The multi handle's connection
+ * cache outlives any one request, so a transfer to a host that another
+ * request just talked to usually goes out on that request's keep-alive
+ * connection instead of paying for a new TCP and TLS handshake.
+ */
+class CurlAsyncDriver {
+public:
+  static void Add(CurlAsyncEvent *event) {
+    static CurlAsyncDriver *s_driver = new CurlAsyncDriver();
+    s_driver->add(event);
+  }
+
+private:
+  CurlAsyncDriver() : m_thread(this, &CurlAsyncDriver::run) {
+    m_multi = curl_multi_init();
+#if LIBCURL_VERSION_NUM >= 0x071003 /* 7.16.3 */
+    curl_multi_setopt(m_multi, CURLMOPT_MAXCONNECTS,
+                      (long)RuntimeOption::HttpAsyncMaxConnections);
+#endif
+    if (pipe(m_wakeup) != 0) {
+      throw Exception("unable to create curl async wakeup pipe: %s",
+                      Util::safe_strerror(errno).c_str());
+    }
+    for (int i = 0; i < 2; i++) {
+      fcntl(m_wakeup[i], F_SETFL, fcntl(m_wakeup[i], F_GETFL) | O_NONBLOCK);
+      fcntl(m_wakeup[i], F_SETFD, FD_CLOEXEC);
+    }
+    m_thread.start();
+  }
+
+  void add(CurlAsyncEvent *event) {
+    {
+      Lock lock(m_mutex);
+      m_pending.push_back(event);
+    }
+    char c = 0;
+    if (write(m_wakeup[1], &c, 1) < 0) {
+      // the pipe is full, so the thread is due to wake up anyway
+    }
+  }
+
+  void run() {
+    while (true) {
+      std::vector<CurlAsyncEvent*> added;
+      {
+        Lock lock(m_mutex);
+        added.swap(m_pending);
+      }
+      for (unsigned int i = 0; i < added.size(); i++) {
+        CURL *cp = added[i]->handle();
+        if (curl_multi_add_handle(m_multi, cp) != CURLM_OK) {
+          added[i]->finish(CURLE_FAILED_INIT);
+          continue;
+        }
+        m_running[cp] = added[i];
+      }
+
+      int running = 0;
+      while (curl_multi_perform(m_multi, &running) ==
+             CURLM_CALL_MULTI_PERFORM) {}
+
+      CURLMsg *msg;
+      int left;
+      while ((msg = curl_multi_info_read(m_multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        CURL *cp = msg->easy_handle;
+        CURLcode error_no = msg->data.result;
+        // msg is no longer valid after this
+        curl_multi_remove_handle(m_multi, cp);
+        std::map<CURL*, CurlAsyncEvent*>::iterator iter = m_running.find(cp);
+        assert(iter != m_running.end());
+        CurlAsyncEvent *event = iter->second;
+        m_running.erase(iter);
+        event->finish(error_no);
+      }
+
+      wait();
+    }
+  }
+
+  /**
+   * Sleep until a socket is ready, curl has a timeout to handle, or add()
+   * has queued a new transfer.
+   */
+  void wait() {
+    long timeout_ms = -1;
+    curl_multi_timeout(m_multi, &timeout_ms);
+    if (timeout_ms < 0 || timeout_ms > 1000) timeout_ms = 1000;
+    if (timeout_ms > 0) {
+#ifdef HAVE_CURL_MULTI_WAIT
+      struct curl_waitfd wakeup;
+      wakeup.fd = m_wakeup[0];
+      wakeup.events = CURL_WAIT_POLLIN;
+      wakeup.revents = 0;
+      curl_multi_wait(m_multi, &wakeup, 1, timeout_ms, NULL);
+#else
+      fd_set read_fds, write_fds, except_fds;
+      int max_fd = -1;
+      FD_ZERO(&read_fds);
+      FD_ZERO(&write_fds);
+      FD_ZERO(&except_fds);
+      curl_multi_fdset(m_multi, &read_fds, &write_fds, &except_fds, &max_fd);
+      FD_SET(m_wakeup[0], &read_fds);
+      struct timeval tv;
+      tv.tv_sec = timeout_ms / 1000;
+      tv.tv_usec = (timeout_ms % 1000) * 1000;
+      select(std::max(max_fd, m_wakeup[0]) + 1, &read_fds, &write_fds,
+             &except_fds, &tv);
+#endif
+    }
+    char buf[64];
+    while (read(m_wakeup[0], buf, sizeof(buf)) > 0) {}
+  }
+
+  Mutex m_mutex;
+  std::vector<CurlAsyncEvent*> m_pending;
+  std::map<CURL*, CurlAsyncEvent*> m_running;
+  CURLM *m_multi;
+  int m_wakeup[2];
+  AsyncFunc<CurlAsyncDriver> m_thread;
+};
+
+Object f_curl_exec_async(CResRef ch) {
+  CurlResource *curl = ch.getTyped<CurlResource>(true, true);
+  if (curl == NULL || curl->get(true) == NULL) {
+    Object e(SystemLib::AllocInvalidArgumentExceptionObject(
+      "Expected a valid cURL handle resource"));
+    throw e;
+  }
+  if (!curl->canExecuteAsync()) {
+    Object e(SystemLib::AllocInvalidArgumentExceptionObject(
+      "curl_exec_async() can not use CURLOPT_FILE, CURLOPT_INFILE, "
+      "CURLOPT_WRITEHEADER or callback functions"));
+    throw e;
+  }
+
+  CurlAsyncEvent *event = new CurlAsyncEvent(curl);
+  try {
+    CurlAsyncDriver::Add(event);
+  } catch (...) {
+    assert(false);
+    event->abandon();
+    Object e(SystemLib::AllocInvalidOperationExceptionObject(
+      "Encountered unexpected exception"));
+    throw e;
+  }
+  return event->getWaitHandle();
+}
+
 const StaticString
   s_url("url"),
   s_content_type("content_type"),
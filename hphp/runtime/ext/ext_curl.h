@@ -35,6 +35,7 @@ bool f_curl_setopt(CResRef ch, int option, CVarRef value);
 bool f_curl_setopt_array(CResRef ch, CArrRef options);
 Variant f_fb_curl_getopt(CResRef ch, int opt = 0);
 Variant f_curl_exec(CResRef ch);
+Object f_curl_exec_async(CResRef ch);
 Variant f_curl_getinfo(CResRef ch, int opt = 0);
 Variant f_curl_errno(CResRef ch);
 Variant f_curl_error(CResRef ch);
@@ -22,6 +22,7 @@
 #include "hphp/runtime/server/server_stats.h"
 #include "hphp/runtime/base/ini_setting.h"
 #include "hphp/runtime/vm/event_hook.h"
+#include "hphp/runtime/vm/stack_sampler.h"
 #include "hphp/util/alloc.h"
 #include "hphp/util/vdso.h"
 #include "hphp/util/cycles.h"
@@ -553,6 +554,12 @@ public:
   virtual void beginFrameEx() {} // called right before a function call
   virtual void endFrameEx() {}   // called right after a function is finished
 
+  /**
+   * Called with each stack StackSampler takes on this thread, folded root
+   * first with ';' between frames.
+   */
+  virtual void sampleStack(const char *folded) {}
+
   /**
    * Final results.
    */
@@ -1366,6 +1373,10 @@ pthread_mutex_t TraceProfiler::s_in_use = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * Sampling based profiler.
+ *
+ * If StackSampler is running, samples come from its timer and the
+ * profiler needs no frame hooks at all. Otherwise the stack is sampled
+ * from beginFrame/endFrame once a sampling interval has passed.
  */
 class SampleProfiler : public Profiler {
 private:
@@ -1374,7 +1385,8 @@ private:
   StatsMap m_stats; // outcome
 
 public:
-  SampleProfiler() {
+  explicit SampleProfiler(bool signalDriven)
+    : m_signalDriven(signalDriven) {
     struct timeval  now;
     uint64_t truncated_us;
     uint64_t truncated_tsc;
@@ -1400,11 +1412,31 @@ public:
   }
 
   virtual void beginFrameEx() {
-    sample_check();
+    if (!m_signalDriven) sample_check();
   }
 
   virtual void endFrameEx() {
-    sample_check();
+    if (!m_signalDriven) sample_check();
+  }
+
+  virtual void sampleStack(const char *folded) {
+    if (!m_signalDriven) return;
+
+    struct timeval now;
+    gettimeofday(&now, 0);
+    char key[512];
+    snprintf(key, sizeof(key), "%" PRId64 ".%06" PRId64,
+             (int64_t)now.tv_sec, (int64_t)now.tv_usec);
+
+    std::string symbol("main()");
+    for (const char *p = folded; *p; ) {
+      const char *end = strchr(p, ';');
+      if (!end) end = p + strlen(p);
+      symbol += HP_STACK_DELIM;
+      symbol.append(p, end - p);
+      p = *end ? end + 1 : end;
+    }
+    m_stats[key][symbol] = 1;
   }
 
   virtual void writeStats(Array &ret) {
@@ -1423,6 +1455,7 @@ public:
 private:
   static const int SAMPLING_INTERVAL = 100000; // microsecs
 
+  bool m_signalDriven;
   struct timeval m_last_sample_time;
   uint64_t m_last_sample_tsc;
   uint64_t m_sampling_interval_tsc;
@@ -1508,7 +1541,11 @@ public:
     if (!RuntimeOption::EnableHotProfiler) {
       return;
     }
-    HPHP::EventHook::Enable();
+    // A sampling profile fed by StackSampler doesn't need frame hooks.
+    bool signalDriven = level == Sample && StackSampler::Running();
+    if (!signalDriven) {
+      HPHP::EventHook::Enable();
+    }
     if (m_profiler == NULL) {
       switch (level) {
       case Simple:
@@ -1518,7 +1555,7 @@ public:
         m_profiler = new HierarchicalProfiler(flags);
         break;
       case Sample:
-        m_profiler = new SampleProfiler();
+        m_profiler = new SampleProfiler(signalDriven);
         break;
       case Trace:
         m_profiler = new TraceProfiler(flags);
@@ -1766,5 +1803,9 @@ void end_profiler_frame(Profiler *p) {
   p->endFrame();
 }
 
+void sample_profiler_stack(Profiler *p, const char *stack) {
+  p->sampleStack(stack);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
@@ -26,8 +26,11 @@
 #include "hphp/runtime/server/server_stats.h"
 #include "hphp/runtime/base/request_local.h"
 #include "hphp/runtime/base/extended_logger.h"
+#include "hphp/runtime/ext/asio/asio_external_thread_event.h"
 #include "hphp/util/timer.h"
 #include "hphp/util/db_mysql.h"
+#include "hphp/util/job_queue.h"
+#include "hphp/util/lock.h"
 #include "netinet/in.h"
 #include <netdb.h>
 
@@ -107,6 +110,126 @@ public:
 };
 IMPLEMENT_STATIC_REQUEST_LOCAL(MySQLRequestData, s_mysql_data);
 
+///////////////////////////////////////////////////////////////////////////////
+// connection pool
+
+/**
+ * Idle connections shared by all requests, keyed by everything that was
+ * fixed when they were opened (see MySQL::GetPoolKey). The most recently
+ * used connection is handed out first; one idle longer than
+ * MySQLConnectionPoolIdleTimeout is closed instead.
+ *
+ * A connection is reset with mysql_change_user() before it is handed out.
+ * That rolls back any open transaction, drops temporary tables, releases
+ * GET_LOCK() locks and returns autocommit, the character set, sql_mode
+ * and user variables to what a fresh connection gets, so no session state
+ * leaks from one request to the next. The same round trip tells a dead
+ * connection apart, and selects the database.
+ */
+class MySQLConnectionPool {
+public:
+  static bool Enabled() {
+    return RuntimeOption::MySQLConnectionPoolSize > 0;
+  }
+
+  /**
+   * Returns null if there is no usable idle connection. The one returned
+   * has been reset and logged in again as username, with database (if not
+   * empty) selected.
+   */
+  static MYSQL *Take(const std::string &key, const std::string &username,
+                     const std::string &password,
+                     const std::string &database);
+
+  /**
+   * Returns false, and leaves conn to the caller, if the pool for key is
+   * full or conn is in the middle of a transaction or a result set.
+   */
+  static bool Put(const std::string &key, MYSQL *conn);
+
+private:
+  struct IdleConn {
+    MYSQL *conn;
+    int64_t since;
+  };
+  typedef std::deque<IdleConn> IdleList;
+
+  static void Expire(IdleList &idle, int64_t now,
+                     std::vector<MYSQL*> &expired);
+
+  static Mutex s_mutex;
+  static hphp_string_map<IdleList> s_idle;
+};
+
+Mutex MySQLConnectionPool::s_mutex;
+hphp_string_map<MySQLConnectionPool::IdleList> MySQLConnectionPool::s_idle;
+
+void MySQLConnectionPool::Expire(IdleList &idle, int64_t now,
+                                 std::vector<MYSQL*> &expired) {
+  int64_t timeout = RuntimeOption::MySQLConnectionPoolIdleTimeout * 1000LL;
+  while (!idle.empty() && now - idle.front().since > timeout) {
+    expired.push_back(idle.front().conn);
+    idle.pop_front();
+  }
+}
+
+MYSQL *MySQLConnectionPool::Take(const std::string &key,
+                                 const std::string &username,
+                                 const std::string &password,
+                                 const std::string &database) {
+  while (true) {
+    IdleConn found;
+    std::vector<MYSQL*> expired;
+    int64_t now = Timer::GetCurrentTimeMicros();
+    {
+      Lock lock(s_mutex);
+      auto iter = s_idle.find(key);
+      if (iter == s_idle.end()) return nullptr;
+      Expire(iter->second, now, expired);
+      if (iter->second.empty()) {
+        found.conn = nullptr;
+      } else {
+        found = iter->second.back();
+        iter->second.pop_back();
+      }
+    }
+    // network round trips happen outside of the lock
+    for (MYSQL *conn : expired) {
+      mysql_close(conn);
+    }
+    if (!found.conn) return nullptr;
+    if (!mysql_change_user(found.conn, username.c_str(), password.c_str(),
+                           database.empty() ? nullptr : database.c_str())) {
+      return found.conn;
+    }
+    mysql_close(found.conn);
+  }
+}
+
+bool MySQLConnectionPool::Put(const std::string &key, MYSQL *conn) {
+  if (!Enabled() || conn->status != MYSQL_STATUS_READY ||
+      (conn->server_status & SERVER_STATUS_IN_TRANS)) {
+    return false;
+  }
+  std::vector<MYSQL*> expired;
+  int64_t now = Timer::GetCurrentTimeMicros();
+  bool pooled = false;
+  {
+    Lock lock(s_mutex);
+    IdleList &idle = s_idle[key];
+    Expire(idle, now, expired);
+    if ((int)idle.size() < RuntimeOption::MySQLConnectionPoolSize) {
+      IdleConn ic = { conn, now };
+      idle.push_back(ic);
+      pooled = true;
+    }
+  }
+  for (MYSQL *c : expired) {
+    mysql_close(c);
+  }
+  return pooled;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // class MySQL statics
 
@@ -177,6 +300,15 @@ String MySQL::GetHash(CStrRef host, int port, CStrRef socket, CStrRef username,
   return String(buf, CopyString);
 }
 
+std::string MySQL::GetPoolKey(CStrRef host, int port, CStrRef socket,
+                              CStrRef username, CStrRef password,
+                              int client_flags, int read_timeout) {
+  // read and write timeouts are fixed once a connection is open
+  String key = GetHash(host, port, socket, username, password, client_flags);
+  return std::string(key.data(), key.size()) + ":" +
+    boost::lexical_cast<std::string>(read_timeout);
+}
+
 MySQL *MySQL::GetCachedImpl(const char *name, CStrRef host, int port,
                             CStrRef socket, CStrRef username, CStrRef password,
                             int client_flags) {
@@ -218,7 +350,8 @@ static MYSQL *create_new_conn() {
 
 MySQL::MySQL(const char *host, int port, const char *username,
              const char *password, const char *database)
-    : m_port(port), m_last_error_set(false), m_last_errno(0),
+    : m_port(port), m_client_flags(0), m_last_error_set(false),
+      m_last_errno(0),
       m_xaction_count(0), m_multi_query(false) {
   if (host) m_host = host;
   if (username) m_username = username;
@@ -247,7 +380,10 @@ void MySQL::close() {
     m_last_errno = 0;
     m_xaction_count = 0;
     m_last_error.clear();
-    mysql_close(m_conn);
+    if (m_pool_key.empty() || m_multi_query ||
+        !MySQLConnectionPool::Put(m_pool_key, m_conn)) {
+      mysql_close(m_conn);
+    }
     m_conn = NULL;
   }
 }
@@ -266,6 +402,8 @@ bool MySQL::connect(CStrRef host, int port, CStrRef socket, CStrRef username,
     ServerStats::Log("sql.conn", 1);
   }
   IOStatusHelper io("mysql::connect", host.data(), port);
+  m_socket = socket.data();
+  m_client_flags = client_flags;
   m_xaction_count = 0;
   bool ret = mysql_real_connect(m_conn, host.data(), username.data(),
                             password.data(),
@@ -321,6 +459,8 @@ bool MySQL::reconnect(CStrRef host, int port, CStrRef socket, CStrRef username,
     ServerStats::Log("sql.reconn_old", 1);
   }
   IOStatusHelper io("mysql::connect", host.data(), port);
+  m_socket = socket.data();
+  m_client_flags = client_flags;
   m_xaction_count = 0;
   return mysql_real_connect(m_conn, host.data(), username.data(),
                             password.data(),
@@ -328,6 +468,32 @@ bool MySQL::reconnect(CStrRef host, int port, CStrRef socket, CStrRef username,
                             port, socket.data(), client_flags);
 }
 
+bool MySQL::connectPooled(CStrRef host, int port, CStrRef socket,
+                          CStrRef username, CStrRef password,
+                          CStrRef database, int client_flags,
+                          int connect_timeout) {
+  std::string key = GetPoolKey(host, port, socket, username, password,
+                               client_flags, s_mysql_data->readTimeout);
+  MYSQL *conn = MySQLConnectionPool::Take(key, username.data(),
+                                          password.data(), database.data());
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
+    ServerStats::Log(conn ? "sql.pool_hit" : "sql.pool_miss", 1);
+  }
+
+  if (conn) {
+    if (m_conn) mysql_close(m_conn);
+    m_conn = conn;
+    m_socket = socket.data();
+    m_client_flags = client_flags;
+    m_xaction_count = 0;
+  } else if (!connect(host, port, socket, username, password, database,
+                      client_flags, connect_timeout)) {
+    return false;
+  }
+  m_pool_key = key;
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // helpers
 
@@ -555,6 +721,13 @@ static Variant php_mysql_do_connect(String server, String username,
 #else
       throw NotImplementedException("mysql_async_connect_start");
 #endif
+    } else if (!persistent && MySQLConnectionPool::Enabled()) {
+      if (!mySQL->connectPooled(host, port, socket, username, password,
+                                database, client_flags, connect_timeout_ms)) {
+        MySQL::SetDefaultConn(mySQL); // so we can report errno by mysql_errno()
+        mySQL->setLastError("mysql_connect");
+        return false;
+      }
     } else {
       if (!mySQL->connect(host, port, socket, username, password,
                           database, client_flags, connect_timeout_ms)) {
@@ -770,9 +943,12 @@ Variant f_mysql_create_db(CStrRef db,
 }
 Variant f_mysql_select_db(CStrRef db,
                                  CVarRef link_identifier /* = uninit_null() */) {
-  MYSQL *conn = MySQL::GetConn(link_identifier);
+  MySQL *rconn = NULL;
+  MYSQL *conn = MySQL::GetConn(link_identifier, &rconn);
   if (!conn) return false;
-  return mysql_select_db(conn, db.data()) == 0;
+  if (mysql_select_db(conn, db.data())) return false;
+  rconn->m_database = db.data(); // for mysql_query_async()
+  return true;
 }
 Variant f_mysql_drop_db(CStrRef db,
                                CVarRef link_identifier /* = uninit_null() */) {
@@ -1561,6 +1737,180 @@ int64_t f_mysql_async_status(CVarRef link_identifier) {
 
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+// queries on worker threads
+
+/**
+ * A query that runs on a worker thread, on a connection of its own taken
+ * from the pool (or opened for it) with the parameters of the link it was
+ * issued on. The link itself stays free, so a request can have many of
+ * these in flight and wait for them together; it also means the query
+ * does not see the link's transaction or session variables.
+ */
+class MySQLQueryEvent : public AsioExternalThreadEvent {
+public:
+  MySQLQueryEvent(const MySQL *link, CStrRef query, int read_timeout)
+    : m_host(link->m_host), m_port(link->m_port), m_socket(link->m_socket),
+      m_username(link->m_username), m_password(link->m_password),
+      m_database(link->m_database), m_client_flags(link->m_client_flags),
+      m_read_timeout(read_timeout), m_query(query.data(), query.size()),
+      m_result(nullptr), m_failed(false) {
+    m_key = MySQL::GetPoolKey(m_host, m_port, m_socket, m_username,
+                              m_password, m_client_flags, m_read_timeout);
+  }
+
+  ~MySQLQueryEvent() {
+    if (m_result) mysql_free_result(m_result);
+  }
+
+  /**
+   * Called on a worker thread.
+   */
+  void run() {
+    MYSQL *conn = MySQLConnectionPool::Take(m_key, m_username, m_password,
+                                            m_database);
+    if (!conn) conn = connect();
+    if (conn && !m_failed) {
+      if (mysql_real_query(conn, m_query.data(), m_query.size())) {
+        setError(conn);
+      } else {
+        m_result = mysql_store_result(conn);
+        if (!m_result && mysql_field_count(conn) > 0) {
+          setError(conn);
+        }
+      }
+    }
+    if (conn && (m_failed || !MySQLConnectionPool::Put(m_key, conn))) {
+      mysql_close(conn);
+    }
+    markAsFinished();
+  }
+
+protected:
+  void unserialize(Cell& result) const {
+    if (m_failed) {
+      raise_notice("runtime/ext_mysql: failed executing [%s] [%s]",
+                   m_query.c_str(), m_error.c_str());
+      cellDup(make_tv<KindOfBoolean>(false), result);
+    } else if (!m_result) {
+      cellDup(make_tv<KindOfBoolean>(true), result);
+    } else {
+      MySQLResult *r = NEWOBJ(MySQLResult)(m_result);
+      m_result = nullptr; // r owns it now
+      cellDup(make_tv<KindOfObject>(r), result);
+    }
+  }
+
+private:
+  MYSQL *connect() {
+    MYSQL *conn = mysql_init(nullptr);
+    mysql_options(conn, MYSQL_OPT_LOCAL_INFILE, 0);
+    if (RuntimeOption::MySQLConnectTimeout) {
+      MySQLUtil::set_mysql_timeout(conn, MySQLUtil::ConnectTimeout,
+                                   RuntimeOption::MySQLConnectTimeout);
+    }
+    if (m_read_timeout) {
+      MySQLUtil::set_mysql_timeout(conn, MySQLUtil::ReadTimeout,
+                                   m_read_timeout);
+      MySQLUtil::set_mysql_timeout(conn, MySQLUtil::WriteTimeout,
+                                   m_read_timeout);
+    }
+    if (!mysql_real_connect(conn, m_host.c_str(), m_username.c_str(),
+                            m_password.c_str(),
+                            m_database.empty() ? nullptr : m_database.c_str(),
+                            m_port,
+                            m_socket.empty() ? nullptr : m_socket.c_str(),
+                            m_client_flags)) {
+      setError(conn);
+      mysql_close(conn);
+      return nullptr;
+    }
+    return conn;
+  }
+
+  void setError(MYSQL *conn) {
+    m_failed = true;
+    const char *error = mysql_error(conn);
+    m_error = error ? error : "";
+  }
+
+  std::string m_host;
+  int m_port;
+  std::string m_socket;
+  std::string m_username;
+  std::string m_password;
+  std::string m_database;
+  int m_client_flags;
+  int m_read_timeout;
+  std::string m_key;
+  std::string m_query;
+
+  mutable MYSQL_RES *m_result;
+  bool m_failed;
+  std::string m_error;
+};
+
+class MySQLQueryWorker : public JobQueueWorker<MySQLQueryEvent*> {
+public:
+  virtual void doJob(MySQLQueryEvent *event) {
+    event->run();
+  }
+  virtual void onThreadEnter() { mysql_thread_init(); }
+  virtual void onThreadExit() { mysql_thread_end(); }
+};
+
+static JobQueueDispatcher<MySQLQueryEvent*, MySQLQueryWorker>
+  *s_query_dispatcher;
+static Mutex s_query_dispatcher_mutex;
+
+static void dispatch_query(MySQLQueryEvent *event) {
+  Lock lock(s_query_dispatcher_mutex);
+  if (!s_query_dispatcher) {
+    s_query_dispatcher =
+      new JobQueueDispatcher<MySQLQueryEvent*, MySQLQueryWorker>
+      (std::max(RuntimeOption::MySQLAsyncQueryThreadCount, 1),
+       false, 0, false, nullptr);
+    s_query_dispatcher->start();
+  }
+  s_query_dispatcher->enqueue(event);
+}
+
+Object f_mysql_query_async(CStrRef query,
+                           CVarRef link_identifier /* = null */) {
+  MySQL *rconn = NULL;
+  MYSQL *conn = MySQL::GetConn(link_identifier, &rconn);
+  if (!conn || !rconn) {
+    Object e(SystemLib::AllocInvalidArgumentExceptionObject(
+      "Expected a valid MySQL-Link resource"));
+    throw e;
+  }
+
+  if (RuntimeOption::MySQLReadOnly &&
+      same(f_preg_match("/^((\\/\\*.*?\\*\\/)|\\(|\\s)*select/i", query),
+           0)) {
+    raise_notice("runtime/ext_mysql: write query not executed [%s]",
+                 query.data());
+    // pretend it worked
+    return c_StaticResultWaitHandle::Create(make_tv<KindOfBoolean>(true));
+  }
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableSQLStats) {
+    ServerStats::Log("sql.query_async", 1);
+  }
+
+  MySQLQueryEvent *event =
+    new MySQLQueryEvent(rconn, query, s_mysql_data->readTimeout);
+  try {
+    dispatch_query(event);
+  } catch (...) {
+    assert(false);
+    event->abandon();
+    Object e(SystemLib::AllocInvalidOperationExceptionObject(
+      "Encountered unexpected exception"));
+    throw e;
+  }
+  return event->getWaitHandle();
+}
+
 Variant f_mysql_fetch_row(CVarRef result) {
   return php_mysql_fetch_hash(result, MYSQL_NUM);
 }
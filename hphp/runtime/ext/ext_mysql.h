@@ -76,6 +76,14 @@ public:
   static MySQL *GetDefaultConn();
   static void SetDefaultConn(MySQL *conn);
 
+  /**
+   * Key of the connection pool an idle connection with these parameters
+   * goes to.
+   */
+  static std::string GetPoolKey(CStrRef host, int port, CStrRef socket,
+                                CStrRef username, CStrRef password,
+                                int client_flags, int read_timeout);
+
 private:
   static int s_default_port;
 
@@ -113,6 +121,15 @@ public:
                  CStrRef password, CStrRef database, int client_flags,
                  int connect_timeout);
 
+  /**
+   * Like connect(), but takes an idle connection from the process-wide
+   * pool if there is one, and gives the connection back to the pool when
+   * this link is closed.
+   */
+  bool connectPooled(CStrRef host, int port, CStrRef socket,
+                     CStrRef username, CStrRef password, CStrRef database,
+                     int client_flags, int connect_timeout);
+
   MYSQL *get() { return m_conn;}
 
 private:
@@ -121,9 +138,12 @@ private:
 public:
   std::string m_host;
   int m_port;
+  std::string m_socket;
   std::string m_username;
   std::string m_password;
   std::string m_database;
+  int m_client_flags;
+  std::string m_pool_key; // empty unless close() may pool m_conn
   bool m_last_error_set;
   int m_last_errno;
   std::string m_last_error;
@@ -267,6 +287,9 @@ Variant f_mysql_async_fetch_array(CVarRef result, int result_type = 1);
 Variant f_mysql_async_wait_actionable(CVarRef items, double timeout);
 int64_t f_mysql_async_status(CVarRef link_identifier);
 
+Object f_mysql_query_async(CStrRef query,
+                           CVarRef link_identifier = uninit_null());
+
 String f_mysql_escape_string(CStrRef unescaped_string);
 
 Variant f_mysql_real_escape_string(CStrRef unescaped_string,
@@ -28,6 +28,8 @@
 #include "hphp/util/util.h"
 #include "hphp/runtime/base/hardware_counter.h"
 
+#include <sys/uio.h>
+
 using std::endl;
 
 namespace HPHP {
@@ -35,6 +37,11 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
 AccessLog::~AccessLog() {
+  if (m_writer) {
+    m_stopping.store(true, std::memory_order_release);
+    wakeWriter();
+    m_writer->waitForEnd();
+  }
   signal(SIGCHLD, SIG_DFL);
   for (uint i = 0; i < m_output.size(); ++i) {
     if (m_output[i].log) {
@@ -105,6 +112,14 @@ void AccessLog::openFiles(const string &username) {
       m_output.emplace_back(fp);
     }
   }
+
+  if (RuntimeOption::AccessLogAsync) {
+    m_pending.reset(new WorkStealingDeque<PendingLine>(
+      Util::roundUpToPowerOfTwo(
+        std::max(RuntimeOption::AccessLogQueueSize, 2))));
+    m_writer.reset(new AsyncFunc<AccessLog>(this, &AccessLog::writerThread));
+    m_writer->start();
+  }
 }
 
 void AccessLog::log(Transport *transport, const VirtualHost *vhost) {
@@ -117,6 +132,12 @@ void AccessLog::log(Transport *transport, const VirtualHost *vhost) {
     int bytes = writeLog(transport, vhost, threadLog, m_defaultFormat.c_str());
     threadData->flusher.recordWriteAndMaybeDropCaches(threadLog, bytes);
   }
+  if (m_pending) {
+    for (uint i = 0; i < m_files.size(); ++i) {
+      queueLine(i, formatLog(transport, vhost, m_files[i].format.c_str()));
+    }
+    return;
+  }
   if (Logger::UseCronolog) {
     for (uint i = 0; i < m_cronOutput.size(); ++i) {
       Cronolog &cronOutput = *m_cronOutput[i];
@@ -140,8 +161,133 @@ void AccessLog::log(Transport *transport, const VirtualHost *vhost) {
   }
 }
 
-int AccessLog::writeLog(Transport *transport, const VirtualHost *vhost,
-                        FILE *outFile, const char *format) {
+void AccessLog::queueLine(uint32_t output, std::string line) {
+  std::string *copy = new std::string(std::move(line));
+  if (!m_pending->push(PendingLine(output, copy))) {
+    delete copy;
+    ServerStats::Log("accesslog.dropped", 1);
+    return;
+  }
+  // Pairs with the fence in writerThread(): either the writer sees this
+  // line before it sleeps, or we see that it is asleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_writerIdle.load(std::memory_order_relaxed)) {
+    wakeWriter();
+  }
+}
+
+void AccessLog::wakeWriter() {
+  Lock lock(m_wakeup.getMutex());
+  m_writerIdle.store(false, std::memory_order_relaxed);
+  m_wakeup.notify();
+}
+
+FILE *AccessLog::outputFile(uint32_t output) {
+  if (Logger::UseCronolog) {
+    return output < m_cronOutput.size() ?
+      m_cronOutput[output]->getOutputFile() : nullptr;
+  }
+  return output < m_output.size() ? m_output[output].log : nullptr;
+}
+
+static ssize_t writevAll(int fd, struct iovec *iov, int count) {
+  ssize_t total = 0;
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return total ? total : -1;
+    }
+    total += n;
+    while (count > 0 && size_t(n) >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return total;
+}
+
+void AccessLog::writeBatch(std::vector<PendingLine> &batch) {
+  // Lines for the same file keep their queue order.
+  std::stable_sort(batch.begin(), batch.end(),
+                   [] (const PendingLine &a, const PendingLine &b) {
+                     return a.output < b.output;
+                   });
+  std::vector<struct iovec> iov;
+  for (size_t start = 0; start < batch.size(); ) {
+    uint32_t output = batch[start].output;
+    size_t end = start;
+    while (end < batch.size() && batch[end].output == output) ++end;
+
+    FILE *outFile = outputFile(output);
+    if (outFile) {
+      iov.clear();
+      for (size_t i = start; i < end; ++i) {
+        iov.push_back({ (void*)batch[i].line->data(),
+                        batch[i].line->size() });
+      }
+      int fd = fileno(outFile);
+      ssize_t bytes = 0;
+      for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+        int count = std::min<size_t>(IOV_MAX, iov.size() - i);
+        ssize_t n = writevAll(fd, &iov[i], count);
+        if (n < 0) break;
+        bytes += n;
+      }
+      if (Logger::UseCronolog) {
+        m_cronOutput[output]->flusher.recordWriteAndMaybeDropCaches(outFile,
+                                                                    bytes);
+      } else if (m_files[output].file[0] != '|') {
+        m_output[output].flusher.recordWriteAndMaybeDropCaches(outFile,
+                                                               bytes);
+      }
+    }
+    for (size_t i = start; i < end; ++i) {
+      delete batch[i].line;
+    }
+    start = end;
+  }
+  batch.clear();
+}
+
+void AccessLog::writerThread() {
+  static const size_t kMaxBatch = 4096;
+  std::vector<PendingLine> batch;
+  batch.reserve(kMaxBatch);
+  while (true) {
+    bool stopping = m_stopping.load(std::memory_order_acquire);
+    PendingLine pending;
+    while (batch.size() < kMaxBatch && m_pending->popFront(pending)) {
+      batch.push_back(pending);
+    }
+    if (!batch.empty()) {
+      writeBatch(batch);
+      continue;
+    }
+    if (stopping) break;
+
+    Lock lock(m_wakeup.getMutex());
+    m_writerIdle.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Waking needs the lock we hold, so a line queued or a stop requested
+    // after these checks can't be missed.
+    while (m_writerIdle.load(std::memory_order_relaxed) &&
+           m_pending->empty() &&
+           !m_stopping.load(std::memory_order_acquire)) {
+      m_wakeup.wait();
+    }
+    m_writerIdle.store(false, std::memory_order_relaxed);
+  }
+}
+
+std::string AccessLog::formatLog(Transport *transport,
+                                 const VirtualHost *vhost,
+                                 const char *format) {
    char c;
    std::ostringstream out;
    while ((c = *format++)) {
@@ -161,7 +307,12 @@ int AccessLog::writeLog(Transport *transport, const VirtualHost *vhost,
      }
    }
    out << endl;
-   string output = out.str();
+   return out.str();
+}
+
+int AccessLog::writeLog(Transport *transport, const VirtualHost *vhost,
+                        FILE *outFile, const char *format) {
+   string output = formatLog(transport, vhost, format);
    int nbytes = fprintf(outFile, "%s", output.c_str());
    fflush(outFile);
    return nbytes;
@@ -305,6 +456,11 @@ bool AccessLog::genField(std::ostringstream &out, const char* &format,
       }
     }
     break;
+  case 'H':
+    // Request hardware counter, e.g. %{cycles}H; see RequestHWEvent.
+    if (arg.empty()) return false;
+    out << ServerStats::Get("page.hw." + arg);
+    break;
   case 'I':
     out << transport->getRequestSize();
     break;
@@ -20,8 +20,14 @@
 #include "hphp/util/thread_local.h"
 #include "hphp/util/logger.h"
 #include "hphp/util/lock.h"
+#include "hphp/util/synchronizable.h"
 #include "hphp/util/cronolog.h"
 #include "hphp/util/util.h"
+#include "hphp/util/async_func.h"
+#include "hphp/util/work_stealing_deque.h"
+
+#include <atomic>
+#include <memory>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -63,7 +69,8 @@ public:
   };
   typedef ThreadData* (*GetThreadDataFunc)();
   explicit AccessLog(GetThreadDataFunc f) :
-      m_initialized(false), m_fGetThreadData(f) {}
+      m_initialized(false), m_fGetThreadData(f), m_stopping(false),
+      m_writerIdle(false) {}
   ~AccessLog();
   void init(const std::string &defaultFormat,
             std::vector<AccessLogFileData> &files,
@@ -83,6 +90,8 @@ private:
                 Transport *transport, const VirtualHost *vhost,
                 const std::string &arg);
   void skipField(const char* &format);
+  std::string formatLog(Transport *transport, const VirtualHost *vhost,
+                        const char *format);
   int writeLog(Transport *transport, const VirtualHost *vhost,
                FILE *outFile, const char *format);
 
@@ -95,6 +104,32 @@ private:
 
   void openFiles(const std::string &username);
   Mutex m_lock;
+
+  /*
+   * With Log.AccessLogAsync, request threads only format their lines and
+   * push them on m_pending; m_writer takes them off in batches and
+   * writev()s them to the log files, so a slow disk never holds up a
+   * response. When the queue is full the line is dropped and counted in
+   * the "accesslog.dropped" server stat. An idle writer sleeps on
+   * m_wakeup with m_writerIdle set, and the next queueLine() wakes it.
+   */
+  struct PendingLine {
+    PendingLine() : output(0), line(nullptr) {}
+    PendingLine(uint32_t o, std::string *l) : output(o), line(l) {}
+    uint32_t output;    // index into m_files
+    std::string *line;
+  };
+  void queueLine(uint32_t output, std::string line);
+  FILE *outputFile(uint32_t output);
+  void writeBatch(std::vector<PendingLine> &batch);
+  void writerThread();
+  void wakeWriter();
+
+  std::unique_ptr<WorkStealingDeque<PendingLine>> m_pending;
+  std::unique_ptr<AsyncFunc<AccessLog>> m_writer;
+  std::atomic<bool> m_stopping;
+  std::atomic<bool> m_writerIdle;
+  Synchronizable m_wakeup;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
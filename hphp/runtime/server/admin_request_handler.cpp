@@ -34,6 +34,7 @@
 #include "hphp/runtime/ext/mysql_stats.h"
 #include "hphp/runtime/base/shared_store_stats.h"
 #include "hphp/runtime/vm/repo.h"
+#include "hphp/runtime/vm/stack_sampler.h"
 #include "hphp/runtime/vm/jit/translator.h"
 #include "hphp/util/alloc.h"
 #include "hphp/util/timer.h"
@@ -184,11 +185,18 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         "/const-ss:        get const_map_size\n"
         "/static-strings:  get number of static strings\n"
         "/dump-apc:        dump all current value in APC to /tmp/apc_dump\n"
+        "/apc-capacity:    get apc memory usage against APC.MemoryLimit and\n"
+        "                  eviction counts\n"
+        "/apc-snapshot:    save apc to APC.SnapshotFile for a warm restart\n"
+        "    file          optional, save to this file in the same directory\n"
+        "    waitseconds   lock-free table: wait for in-flight operations,\n"
+        "                  default is the request timeout\n"
         "/dump-const:      dump all constant value in constant map to\n"
         "                  /tmp/const_map_dump\n"
         "/dump-file-repo:  dump file repository to /tmp/file_repo_dump\n"
 
         "/pcre-cache-size: get pcre cache map size\n"
+        "/pcre-cache-stats:get pcre cache hit/miss/eviction counts\n"
 
 #ifdef GOOGLE_CPU_PROFILER
         "/prof-cpu-on:     turn on CPU profiler\n"
@@ -207,6 +215,13 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
 #ifdef EXECUTION_PROFILER
         "/prof-exe:        returns sampled execution profile\n"
 #endif
+        "/prof-sample-on:  start sampling PHP stacks; refused while the\n"
+        "                  CPU profiler is on, as both use SIGPROF\n"
+        "    interval      optional, microseconds of a thread's CPU time\n"
+        "                  between samples, default 10000\n"
+        "/prof-sample-off: stop sampling PHP stacks\n"
+        "/prof-sample-dump:show sampled stacks as folded stacks\n"
+        "/prof-sample-clear:forget sampled stacks\n"
         "/vm-tcspace:      show space used by translator caches\n"
         "/vm-dump-tc:      dump translation cache to /tmp/tc_dump_a and\n"
         "                  /tmp/tc_dump_astub\n"
@@ -339,6 +354,57 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
       break;
     }
 
+    if (cmd == "pcre-cache-stats") {
+      PCRECacheStats stats;
+      preg_pcre_cache_stats(stats);
+      std::ostringstream out;
+      out << "size: " << stats.size << endl
+          << "capacity: " << stats.capacity << endl
+          << "hits: " << stats.hits << endl
+          << "misses: " << stats.misses << endl
+          << "evictions: " << stats.evictions << endl;
+      transport->sendString(out.str());
+      break;
+    }
+
+    if (cmd == "apc-capacity") {
+      if (!RuntimeOption::EnableApc) {
+        transport->sendString("No APC\n");
+        break;
+      }
+      std::ostringstream out;
+      s_apc_store[SHARED_STORE_APPLICATION_CACHE].dumpCapacity(out);
+      transport->sendString(out.str());
+      break;
+    }
+
+    if (cmd == "apc-snapshot") {
+      string file = RuntimeOption::ApcSnapshotFile;
+      string name = transport->getParam("file");
+      if (!name.empty() && !file.empty()) {
+        // Only a plain name, next to the configured snapshot file.
+        if (name.find('/') != string::npos || name == "." || name == "..") {
+          transport->sendString("Invalid snapshot file name\n");
+          break;
+        }
+        size_t slash = file.rfind('/');
+        file = slash == string::npos ? name : file.substr(0, slash + 1) + name;
+      }
+      int waitSeconds = transport->getIntParam("waitseconds");
+      if (!waitSeconds) {
+        waitSeconds = RuntimeOption::RequestTimeoutSeconds > 0 ?
+                      RuntimeOption::RequestTimeoutSeconds : 10;
+      }
+      if (file.empty()) {
+        transport->sendString("No snapshot file\n");
+      } else if (apc_save_snapshot(file.c_str(), waitSeconds)) {
+        transport->sendString("Done");
+      } else {
+        transport->sendString("Failed");
+      }
+      break;
+    }
+
 #ifdef USE_TCMALLOC
     if (MallocExtensionInstance) {
       if (cmd == "free-mem") {
@@ -746,6 +812,39 @@ bool AdminRequestHandler::handleProfileRequest(const std::string &cmd,
 
     return true;
   }
+  if (cmd == "prof-sample-on") {
+    int interval = transport->getIntParam("interval");
+    if (interval <= 0) interval = 10000;
+#ifdef GOOGLE_CPU_PROFILER
+    // both want SIGPROF
+    if (ProfilingIsEnabledForAllThreads()) {
+      transport->sendString("The CPU profiler is running.\n", 409);
+      return true;
+    }
+#endif
+    if (StackSampler::Start(interval)) {
+      transport->sendString("OK\n");
+    } else {
+      transport->sendString("Unable to start the profiling timer.\n", 500);
+    }
+    return true;
+  }
+  if (cmd == "prof-sample-off") {
+    StackSampler::Stop();
+    transport->sendString("OK\n");
+    return true;
+  }
+  if (cmd == "prof-sample-dump") {
+    string out;
+    StackSampler::Report(out);
+    transport->sendString(out);
+    return true;
+  }
+  if (cmd == "prof-sample-clear") {
+    StackSampler::Clear();
+    transport->sendString("OK\n");
+    return true;
+  }
 #ifdef GOOGLE_CPU_PROFILER
   if (handleCPUProfilerRequest(cmd, transport)) {
     return true;
@@ -766,6 +865,10 @@ bool AdminRequestHandler::handleCPUProfilerRequest(const std::string &cmd,
     Process::HostName + "/hphp.prof";
 
   if (cmd == "prof-cpu-on") {
+    if (StackSampler::Running()) {
+      transport->sendString("The stack sampler is running.\n", 409);
+      return true;
+    }
     if (Util::mkdir(file)) {
       ProfilerStart(file.c_str());
       transport->sendString("OK\n");
@@ -21,6 +21,7 @@
 #include "hphp/util/timer.h"
 #include "hphp/runtime/server/static_content_cache.h"
 #include "hphp/runtime/server/dynamic_content_cache.h"
+#include "hphp/runtime/server/static_file_cache.h"
 #include "hphp/runtime/server/server_stats.h"
 #include "hphp/util/network.h"
 #include "hphp/runtime/base/preg.h"
@@ -49,12 +50,10 @@ HttpRequestHandler::HttpRequestHandler()
                                  "requests_timed_out_on_queue",
                                  {ServiceData::StatsType::COUNT})) { }
 
-void HttpRequestHandler::sendStaticContent(Transport *transport,
-                                           const char *data, int len,
-                                           time_t mtime,
-                                           bool compressed,
-                                           const std::string &cmd,
-                                           const char *ext) {
+void HttpRequestHandler::addStaticContentHeaders(Transport *transport,
+                                                 time_t mtime,
+                                                 const std::string &cmd,
+                                                 const char *ext) {
   assert(ext);
   assert(cmd.rfind('.') != string::npos);
   assert(strcmp(ext, cmd.c_str() + cmd.rfind('.') + 1) == 0);
@@ -106,10 +105,45 @@ void HttpRequestHandler::sendStaticContent(Transport *transport,
   // misnomer, it means we have made decision on compression, transport
   // should not attempt to compress it.
   transport->disableCompression();
+}
 
+void HttpRequestHandler::sendStaticContent(Transport *transport,
+                                           const char *data, int len,
+                                           time_t mtime,
+                                           bool compressed,
+                                           const std::string &cmd,
+                                           const char *ext) {
+  addStaticContentHeaders(transport, mtime, cmd, ext);
   transport->sendRaw((void*)data, len, 200, compressed);
 }
 
+bool HttpRequestHandler::sendStaticFile(Transport *transport,
+                                        const std::string &file,
+                                        const std::string &cmd,
+                                        const char *ext) {
+  StaticFileCache::EntryPtr entry = StaticFileCache::TheCache.find(file);
+  if (!entry || entry->size > INT_MAX) return false;
+
+  bool compressed = false;
+  if (RuntimeOption::EnableStaticContentGzipSiblings &&
+      transport->acceptEncoding("gzip")) {
+    StaticFileCache::EntryPtr gz =
+      StaticFileCache::TheCache.find(file + ".gz");
+    // a sibling older than the file itself is stale
+    if (gz && gz->mtime >= entry->mtime && gz->size <= INT_MAX) {
+      entry = gz;
+      compressed = true;
+    }
+  }
+
+  addStaticContentHeaders(transport, entry->mtime, cmd, ext);
+  if (RuntimeOption::EnableStaticContentGzipSiblings) {
+    transport->addHeader("Vary", "Accept-Encoding");
+  }
+  transport->sendFile(entry->fd, 0, entry->size, 200, compressed);
+  return true;
+}
+
 void HttpRequestHandler::handleRequest(Transport *transport) {
   ExecutionProfiler ep(ThreadInfo::RuntimeFunctions);
 
@@ -218,7 +252,13 @@ void HttpRequestHandler::handleRequest(Transport *transport) {
 
     if (RuntimeOption::EnableStaticContentFromDisk) {
       String translated = File::TranslatePath(String(absPath));
-      if (!translated.empty()) {
+      if (!translated.empty() && RuntimeOption::EnableStaticContentSendFile) {
+        if (sendStaticFile(transport, translated.data(), path, ext)) {
+          ServerStats::LogPage(path, 200);
+          GetAccessLog().log(transport, vhost);
+          return;
+        }
+      } else if (!translated.empty()) {
         CstrBuffer sb(translated.data());
         if (sb.valid()) {
           struct stat st;
@@ -51,10 +51,14 @@ private:
   ServiceData::ExportedTimeSeries* m_requestTimedOutOnQueue;
 
   bool handleProxyRequest(Transport *transport, bool force);
+  void addStaticContentHeaders(Transport *transport, time_t mtime,
+                               const std::string &cmd, const char *ext);
   void sendStaticContent(Transport *transport, const char *data, int len,
                          time_t mtime, bool compressed,
                          const std::string &cmd,
                          const char *ext);
+  bool sendStaticFile(Transport *transport, const std::string &file,
+                      const std::string &cmd, const char *ext);
   bool executePHPRequest(Transport *transport, RequestURI &reqURI,
                          SourceRootInfo &sourceRootInfo,
                          bool cachableDynamicContent);
@@ -304,6 +304,12 @@ void HttpServer::run() {
     m_serviceThreads[i]->waitForEnd();
   }
 
+  // no more requests can touch apc at this point
+  if (RuntimeOption::ApcSnapshotOnShutdown &&
+      !RuntimeOption::ApcSnapshotFile.empty()) {
+    apc_save_snapshot(RuntimeOption::ApcSnapshotFile.c_str());
+  }
+
   hphp_process_exit();
   m_watchDog.waitForEnd();
   Logger::Info("all servers stopped");
@@ -25,6 +25,8 @@
 #include "hphp/util/logger.h"
 #include "hphp/util/timer.h"
 
+#include <sys/sendfile.h>
+
 ///////////////////////////////////////////////////////////////////////////////
 // static handler
 
@@ -159,7 +161,8 @@ LibEventServer::LibEventServer(const std::string &address, int port,
     m_dispatcher(thread, RuntimeOption::ServerThreadRoundRobin,
                  RuntimeOption::ServerThreadDropCacheTimeoutSeconds,
                  RuntimeOption::ServerThreadDropStack,
-                 this, RuntimeOption::ServerThreadJobLIFOSwitchThreshold),
+                 this, RuntimeOption::ServerThreadJobLIFOSwitchThreshold,
+                 RuntimeOption::ServerThreadJobWorkStealing),
     m_dispatcherThread(this, &LibEventServer::dispatch) {
   m_eventBase = event_base_new();
   m_server = evhttp_new(m_eventBase);
@@ -428,6 +431,83 @@ void LibEventServer::onResponse(int worker, evhttp_request *request,
   m_responseQueue.enqueue(worker, request, code, nwritten);
 }
 
+// libevent is not exposing this data structure, but we need it. This is the
+// head of struct evhttp_connection from libevent 1.4's http-internal.h.
+struct m_evhttp_connection {
+  struct {
+    void *tqe_next;
+    void **tqe_prev;
+  } next;
+  int fd;
+  struct event ev;
+  struct event close_ev;
+  struct evbuffer *input_buffer;
+  struct evbuffer *output_buffer;
+};
+
+/*
+ * Write size bytes of fd, from offset on, to the connection: straight to
+ * the socket with sendfile() for as long as it takes data without
+ * blocking, then whatever is left into the connection's output buffer for
+ * the event loop to write. Returns false if the connection should be
+ * dropped.
+ */
+static bool send_file(m_evhttp_connection *evcon, int fd, off_t offset,
+                      int size) {
+  if (EVBUFFER_LENGTH(evcon->output_buffer) == 0) {
+    while (size > 0) {
+      ssize_t n = sendfile(evcon->fd, fd, &offset, size);
+      if (n > 0) {
+        size -= n;
+      } else if (n < 0 && errno == EAGAIN) {
+        break;
+      } else if (n == 0 || errno != EINTR) {
+        return false; // the file shrank, or the socket is gone
+      }
+    }
+  }
+
+  char buf[64 * 1024];
+  while (size > 0) {
+    ssize_t n = pread(fd, buf, std::min(size, (int)sizeof(buf)), offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    evbuffer_add(evcon->output_buffer, buf, n);
+    offset += n;
+    size -= n;
+  }
+  return true;
+}
+
+void LibEventServer::onSendFile(int worker, evhttp_request *request,
+                                int code, int fd, off_t offset, int size,
+                                LibEventTransport *transport) {
+  if (request->evcon == nullptr) {
+    evhttp_request_free(request);
+    return;
+  }
+
+  const char *reason = HttpProtocol::GetReasonString(code);
+  timespec begin, end;
+  Timer::GetMonotonicTime(begin);
+  // The output buffer is empty, so this only writes the headers.
+  int nwritten = evhttp_send_reply_sync_begin(request, code, reason, nullptr);
+  if (nwritten > 0) {
+    m_evhttp_connection *evcon = (m_evhttp_connection*)request->evcon;
+    size_t pending = EVBUFFER_LENGTH(evcon->output_buffer);
+    if (!send_file(evcon, fd, offset, size)) {
+      nwritten = -1;
+    } else {
+      nwritten += size - (EVBUFFER_LENGTH(evcon->output_buffer) - pending);
+    }
+  }
+  Timer::GetMonotonicTime(end);
+  int64_t delay = gettime_diff_us(begin, end);
+  transport->onFlushBegin(size);
+  transport->onFlushProgress(std::max(nwritten, 0), delay);
+  m_responseQueue.enqueue(worker, request, code, nwritten);
+}
+
 void LibEventServer::onChunkedResponse(int worker, evhttp_request *request,
                                        int code, evbuffer *chunk,
                                        bool firstChunk) {
@@ -160,6 +160,9 @@ public:
    */
   void onResponse(int worker, evhttp_request *request, int code,
                   LibEventTransport* transport);
+  void onSendFile(int worker, evhttp_request *request, int code,
+                  int fd, off_t offset, int size,
+                  LibEventTransport* transport);
   void onChunkedResponse(int worker, evhttp_request *request, int code,
                          evbuffer *chunk, bool firstChunk);
   void onChunkedResponseEnd(int worker, evhttp_request *request);
@@ -292,6 +292,31 @@ void LibEventTransport::sendImpl(const void *data, int size, int code,
   m_sendStarted = true;
 }
 
+bool LibEventTransport::canSendFile() {
+  // The body is written from this thread, right behind the headers, so
+  // this needs the synchronous send path.
+  if (!RuntimeOption::LibEventSyncSend || m_method == Method::HEAD ||
+      m_sendStarted || m_request->evcon == nullptr) {
+    return false;
+  }
+#ifdef _EVENT_USE_OPENSSL
+  if (evhttp_is_connection_ssl(m_request->evcon)) return false;
+#endif
+  return true;
+}
+
+void LibEventTransport::sendFileImpl(int fd, off_t offset, int size,
+                                     int code) {
+  assert(canSendFile());
+  char buf[11];
+  snprintf(buf, sizeof(buf), "%d", size);
+  removeHeaderImpl("Content-Length");
+  addHeaderImpl("Content-Length", buf);
+  m_server->onSendFile(m_workerId, m_request, code, fd, offset, size, this);
+  m_sendStarted = true;
+  m_sendEnded = true;
+}
+
 void LibEventTransport::onSendEndImpl() {
   if (m_chunkedEncoding) {
     m_server->onChunkedResponseEnd(m_workerId, m_request);
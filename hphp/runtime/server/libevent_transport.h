@@ -49,6 +49,8 @@ public:
   virtual void removeRequestHeaderImpl(const char *name);
   virtual void sendImpl(const void *data, int size, int code, bool chunked);
   virtual void onSendEndImpl();
+  virtual bool canSendFile();
+  virtual void sendFileImpl(int fd, off_t offset, int size, int code);
   virtual bool isServerStopping();
   virtual int getRequestSize() const;
 
@@ -38,6 +38,17 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 // helpers
 
+static const struct {
+  const char *name;
+  double fraction;
+} s_wallPercentiles[] = {
+  { "page.wall.p50",  0.5   },
+  { "page.wall.p99",  0.99  },
+  { "page.wall.p999", 0.999 },
+};
+static const int s_numWallPercentiles =
+  sizeof(s_wallPercentiles) / sizeof(s_wallPercentiles[0]);
+
 void ServerStats::GetLogger() {
   s_logger.getCheck();
 }
@@ -49,6 +60,12 @@ void ServerStats::Merge(CounterMap &dest, const CounterMap &src) {
   }
 }
 
+void ServerStats::Merge(PageStats &dest, const PageStats &src) {
+  dest.m_hit += src.m_hit;
+  Merge(dest.m_values, src.m_values);
+  dest.m_wall.merge(src.m_wall);
+}
+
 void ServerStats::Merge(PageStatsMap &dest, const PageStatsMap &src) {
   for (PageStatsMap::const_iterator iter = src.begin();
        iter != src.end(); ++iter) {
@@ -62,12 +79,48 @@ void ServerStats::Merge(PageStatsMap &dest, const PageStatsMap &src) {
       PageStats &d = diter->second;
       assert(d.m_url == s.m_url);
       assert(d.m_code == s.m_code);
-      d.m_hit += s.m_hit;
-      Merge(d.m_values, s.m_values);
+      Merge(d, s);
     }
   }
 }
 
+int ServerStats::LatencyHistogram::BucketOf(int64_t value) {
+  if (value < 16) return value < 0 ? 0 : value;
+  int msb = 63 - __builtin_clzll(value);
+  int sub = (value >> (msb - 4)) & 15;
+  return 16 + (msb - 4) * 16 + sub;
+}
+
+int64_t ServerStats::LatencyHistogram::BucketMax(int bucket) {
+  if (bucket < 16) return bucket;
+  int shift = (bucket - 16) / 16;
+  int64_t sub = (bucket - 16) % 16;
+  return ((16 + sub + 1) << shift) - 1;
+}
+
+void ServerStats::LatencyHistogram::add(int64_t value) {
+  m_buckets[BucketOf(value)]++;
+  m_count++;
+}
+
+void ServerStats::LatencyHistogram::merge(const LatencyHistogram &src) {
+  for (auto &bucket : src.m_buckets) {
+    m_buckets[bucket.first] += bucket.second;
+  }
+  m_count += src.m_count;
+}
+
+int64_t ServerStats::LatencyHistogram::percentile(double fraction) const {
+  int64_t rank = (int64_t)ceil(fraction * m_count);
+  if (rank < 1) rank = 1;
+  int64_t seen = 0;
+  for (auto &bucket : m_buckets) {
+    seen += bucket.second;
+    if (seen >= rank) return BucketMax(bucket.first);
+  }
+  return m_buckets.empty() ? 0 : BucketMax(m_buckets.rbegin()->first);
+}
+
 void ServerStats::Merge(list<TimeSlot*> &dest, const list<TimeSlot*> &src) {
   list<TimeSlot*>::iterator diter = dest.begin();
   for (list<TimeSlot*>::const_iterator iter = src.begin();
@@ -117,6 +170,9 @@ void ServerStats::GetAllKeys(set<string> &allKeys,
   allKeys.insert("load");
   allKeys.insert("idle");
   allKeys.insert("queued");
+  for (int i = 0; i < s_numWallPercentiles; i++) {
+    allKeys.insert(s_wallPercentiles[i].name);
+  }
 }
 
 void ServerStats::Filter(list<TimeSlot*> &slots, const std::string &keys,
@@ -228,10 +284,9 @@ void ServerStats::Aggregate(list<TimeSlot*> &slots, const std::string &agg,
           code = 0;
         }
         PageStats &psDest = ts->m_pages[url + lexical_cast<string>(code)];
-        psDest.m_hit += ps.m_hit;
         psDest.m_url = url;
         psDest.m_code = code;
-        Merge(psDest.m_values, ps.m_values);
+        Merge(psDest, ps);
       }
     }
     FreeSlots(slots);
@@ -274,6 +329,16 @@ void ServerStats::Aggregate(list<TimeSlot*> &slots, const std::string &agg,
       if (wantedKeys.find("queued") != wantedKeys.end()) {
         values["queued"] = queued;
       }
+      // Percentiles can't be summed like other values, so they are only
+      // worked out here, after any aggregation.
+      if (!ps.m_wall.empty()) {
+        for (int i = 0; i < s_numWallPercentiles; i++) {
+          const char *name = s_wallPercentiles[i].name;
+          if (wantedKeys.empty() || wantedKeys.find(name) != wantedKeys.end()) {
+            values[name] = ps.m_wall.percentile(s_wallPercentiles[i].fraction);
+          }
+        }
+      }
 
       for (map<string, int>::const_iterator iter = udfKeys.begin();
            iter != udfKeys.end(); ++iter) {
@@ -602,6 +667,8 @@ private:
 
 Mutex ServerStats::s_lock;
 vector<ServerStats*> ServerStats::s_loggers;
+SharedString ServerStats::s_counterNames[ServerStats::kMaxCounters];
+std::atomic<int> ServerStats::s_counterCount(0);
 bool ServerStats::s_profile_network = false;
 IMPLEMENT_THREAD_LOCAL_NO_CHECK(ServerStats, ServerStats::s_logger);
 
@@ -611,6 +678,26 @@ void ServerStats::LogPage(const string &url, int code) {
   }
 }
 
+ServerStats::CounterHandle
+ServerStats::RegisterCounter(const std::string &name) {
+  Lock lock(s_lock, false);
+  SharedString sname(name);
+  int count = s_counterCount.load(std::memory_order_relaxed);
+  for (int i = 0; i < count; i++) {
+    if (s_counterNames[i].get() == sname.get()) return i;
+  }
+  always_assert(count < kMaxCounters);
+  s_counterNames[count] = sname;
+  s_counterCount.store(count + 1, std::memory_order_release);
+  return count;
+}
+
+void ServerStats::Log(CounterHandle counter, int64_t value) {
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    ServerStats::s_logger->log(counter, value);
+  }
+}
+
 void ServerStats::Log(const string &name, int64_t value) {
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
     ServerStats::s_logger->log(name, value);
@@ -996,7 +1083,10 @@ ServerStats::ThreadStatus::ThreadStatus()
   memset(m_vhost, 0, sizeof(m_vhost));
 }
 
-ServerStats::ServerStats() : m_last(0), m_min(0), m_max(0) {
+ServerStats::ServerStats()
+    : m_last(0), m_min(0), m_max(0), m_pageStarted(false),
+      m_hwCounting(false) {
+  memset(m_counters, 0, sizeof(m_counters));
   m_slots.resize(RuntimeOption::StatsMaxSlot);
   clear();
 
@@ -1038,6 +1128,37 @@ int64_t ServerStats::get(const std::string &name) {
 }
 
 void ServerStats::logPage(const string &url, int code) {
+  int64_t wallTime = -1;
+  if (m_pageStarted) {
+    timespec now;
+    Timer::GetMonotonicTime(now);
+    wallTime = gettime_diff_us(m_pageStart, now);
+    m_pageStarted = false;
+  }
+  if (m_hwCounting) {
+    static const std::vector<CounterHandle> s_hwCounters = [] {
+      std::vector<CounterHandle> handles;
+      for (int i = 0; i < NumRequestHWEvents; i++) {
+        handles.push_back(
+          RegisterCounter(string("page.hw.") + kRequestHWEventNames[i]));
+      }
+      return handles;
+    }();
+    int64_t counts[NumRequestHWEvents];
+    HardwareCounter::GetRequestCounts(counts);
+    for (int i = 0; i < NumRequestHWEvents; i++) {
+      log(s_hwCounters[i], counts[i] - m_hwStart[i]);
+    }
+    m_hwCounting = false;
+  }
+  int counterCount = s_counterCount.load(std::memory_order_acquire);
+  for (int i = 0; i < counterCount; i++) {
+    if (m_counters[i]) {
+      m_values[s_counterNames[i]] += m_counters[i];
+      m_counters[i] = 0;
+    }
+  }
+
   int64_t now = time(nullptr) / RuntimeOption::StatsSlotDuration;
   int slot = now % RuntimeOption::StatsMaxSlot;
 
@@ -1063,6 +1184,9 @@ void ServerStats::logPage(const string &url, int code) {
     ps.m_code = code;
     ps.m_hit++;
     Merge(ps.m_values, m_values);
+    if (wallTime >= 0) {
+      ps.m_wall.add(wallTime);
+    }
   }
 
   m_last = now;
@@ -1079,6 +1203,7 @@ void ServerStats::logPage(const string &url, int code) {
 
 void ServerStats::reset() {
   m_values.clear();
+  memset(m_counters, 0, sizeof(m_counters));
 }
 
 void ServerStats::clear() {
@@ -1133,6 +1258,13 @@ void ServerStats::startRequest(const char *url, const char *clientIP,
   safe_copy(m_threadStatus.m_clientIP, clientIP,
             sizeof(m_threadStatus.m_clientIP));
   safe_copy(m_threadStatus.m_vhost, vhost, sizeof(m_threadStatus.m_vhost));
+
+  m_pageStarted = true;
+  Timer::GetMonotonicTime(m_pageStart);
+  m_hwCounting = RuntimeOption::EnableHWCounterStats;
+  if (m_hwCounting) {
+    HardwareCounter::GetRequestCounts(m_hwStart);
+  }
 }
 
 void ServerStats::setThreadMode(ThreadMode mode) {
@@ -20,9 +20,12 @@
 #include "hphp/util/lock.h"
 #include "hphp/util/thread_local.h"
 #include "curl/curl.h"
+#include <atomic>
+#include <map>
 #include <time.h>
 #include "hphp/runtime/base/shared_string.h"
 #include "hphp/runtime/base/types.h"
+#include "hphp/runtime/base/hardware_counter.h"
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -44,6 +47,17 @@ public:
   };
 
 public:
+  /*
+   * A counter that is logged often can be registered once, up front, and
+   * then logged through its handle: that adds to a per-thread array instead
+   * of interning the name on every call. The totals are folded into the
+   * page's values by LogPage(). Registering the same name twice returns the
+   * same handle.
+   */
+  typedef int CounterHandle;
+  static CounterHandle RegisterCounter(const std::string &name);
+  static void Log(CounterHandle counter, int64_t value);
+
   static void Log(const std::string &name, int64_t value);
   static int64_t Get(const std::string &name);
   static void LogPage(const std::string &url, int code);
@@ -86,17 +100,49 @@ private:
     PRECISION = 1000
   };
 
+  static const int kMaxCounters = 256;
+
   static Mutex s_lock;
   static std::vector<ServerStats*> s_loggers;
+  static SharedString s_counterNames[kMaxCounters];
+  static std::atomic<int> s_counterCount;
   static DECLARE_THREAD_LOCAL_NO_CHECK(ServerStats, s_logger);
 
   typedef hphp_shared_string_map<int64_t> CounterMap;
 
+  /*
+   * Log-linear latency histogram, in the manner of HdrHistogram: values
+   * below 16 get a bucket each, and every power of two above that is split
+   * into 16 buckets, so a bucket is never wider than 1/16 of the values in
+   * it. Only buckets that were hit are stored, since most pages only ever
+   * hit a few.
+   */
+  class LatencyHistogram {
+  public:
+    LatencyHistogram() : m_count(0) {}
+
+    void add(int64_t value);
+    void merge(const LatencyHistogram &src);
+    bool empty() const { return m_count == 0; }
+
+    // Highest value in the bucket holding the given fraction (0, 1] of all
+    // values.
+    int64_t percentile(double fraction) const;
+
+  private:
+    static int BucketOf(int64_t value);
+    static int64_t BucketMax(int bucket);
+
+    int64_t m_count;
+    std::map<int, int64_t> m_buckets;
+  };
+
   struct PageStats {
     std::string m_url; // which page
     int m_code;        // response code
     int m_hit;         // page hits
     CounterMap m_values; // name value pairs
+    LatencyHistogram m_wall; // microseconds from StartRequest() to LogPage()
   };
   typedef hphp_shared_string_map<PageStats> PageStatsMap;
   struct TimeSlot {
@@ -105,6 +151,7 @@ private:
   };
 
   static void Merge(CounterMap &dest, const CounterMap &src);
+  static void Merge(PageStats &dest, const PageStats &src);
   static void Merge(PageStatsMap &dest, const PageStatsMap &src);
   static void Merge(std::list<TimeSlot*> &dest,
                     const std::list<TimeSlot*> &src);
@@ -129,7 +176,20 @@ private:
   int64_t m_min;  // earliest timepoint
   int64_t m_max;  // latest timepoint
   CounterMap m_values;  // current page's name value pairs
+  int64_t m_counters[kMaxCounters]; // current page's registered counters
+
+  // Set by startRequest() for logPage().
+  bool m_pageStarted;
+  timespec m_pageStart;
+
+  // Request hardware counters as of startRequest(), turned into
+  // "page.hw.<event>" values by logPage().
+  bool m_hwCounting;
+  int64_t m_hwStart[NumRequestHWEvents];
 
+  void log(CounterHandle counter, int64_t value) {
+    m_counters[counter] += value;
+  }
   void log(const std::string &name, int64_t value);
   int64_t get(const std::string &name);
   void logPage(const std::string &url, int code);
@@ -0,0 +1,113 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+
+#include "hphp/runtime/server/static_file_cache.h"
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/util/lock.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+StaticFileCache StaticFileCache::TheCache;
+
+StaticFileCache::Entry::Entry(int fd, const struct stat &st)
+  : fd(fd), size(st.st_size), mtime(st.st_mtime), ino(st.st_ino),
+    dev(st.st_dev), referenced(true) {
+}
+
+StaticFileCache::Entry::~Entry() {
+  close(fd);
+}
+
+StaticFileCache::StaticFileCache() {
+}
+
+StaticFileCache::EntryPtr StaticFileCache::find(const std::string &path) {
+  assert(!path.empty());
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    erase(path);
+    return EntryPtr();
+  }
+
+  {
+    ReadLock lock(m_mutex);
+    StringToEntryPtrMap::const_iterator iter = m_files.find(path);
+    if (iter != m_files.end() && iter->second->matches(st)) {
+      iter->second->referenced.store(true, std::memory_order_relaxed);
+      return iter->second;
+    }
+  }
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    erase(path);
+    return EntryPtr();
+  }
+  // stat again through the descriptor, in case the file was replaced
+  // between the stat() above and the open()
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    erase(path);
+    return EntryPtr();
+  }
+  EntryPtr entry(new Entry(fd, st));
+
+  WriteLock lock(m_mutex);
+  StringToEntryPtrMap::iterator iter = m_files.find(path);
+  if (iter != m_files.end()) {
+    iter->second = entry;
+  } else if (RuntimeOption::StaticFileFdCacheSize > 0) {
+    while ((int)m_files.size() >= RuntimeOption::StaticFileFdCacheSize) {
+      evictLocked();
+    }
+    m_files[path] = entry;
+  }
+  return entry;
+}
+
+void StaticFileCache::erase(const std::string &path) {
+  {
+    ReadLock lock(m_mutex);
+    if (m_files.find(path) == m_files.end()) return;
+  }
+  // requests still holding the entry keep its descriptor open until they
+  // are done with it
+  WriteLock lock(m_mutex);
+  m_files.erase(path);
+}
+
+void StaticFileCache::evictLocked() {
+  assert(!m_files.empty());
+  StringToEntryPtrMap::iterator iter = m_files.find(m_hand);
+  // Hits only set the bit under the read lock, so with the write lock held
+  // a full turn clears every bit and this stops within size() + 1 steps.
+  while (true) {
+    if (iter == m_files.end()) iter = m_files.begin();
+    if (!iter->second->referenced.exchange(false)) break;
+    ++iter;
+  }
+  m_files.erase(iter++);
+  m_hand = iter == m_files.end() ? std::string() : iter->first;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
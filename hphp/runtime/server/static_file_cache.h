@@ -0,0 +1,89 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+
+#ifndef incl_HPHP_STATIC_FILE_CACHE_H_
+#define incl_HPHP_STATIC_FILE_CACHE_H_
+
+#include "hphp/util/base.h"
+#include "hphp/util/mutex.h"
+
+#include <atomic>
+#include <sys/stat.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Open file descriptors for static files served from disk. A hot asset then
+ * costs one stat() per request instead of open/read/close, and its body can
+ * be handed to Transport::sendFile() without being read into memory.
+ *
+ * Every lookup stats the file and reopens it if its size, mtime or inode
+ * changed, and drops it once the file is gone. Entries are reference
+ * counted, so a request keeps a descriptor usable even if another thread
+ * replaces or drops it in the meantime. The cache holds at most
+ * Server.StaticFileFdCacheSize descriptors; beyond that a clock sweep
+ * closes one that has not been served since the hand last passed it.
+ */
+class StaticFileCache {
+public:
+  static StaticFileCache TheCache;
+
+  DECLARE_BOOST_TYPES(Entry);
+  class Entry {
+  public:
+    Entry(int fd, const struct stat &st);
+    ~Entry();
+
+    bool matches(const struct stat &st) const {
+      return size == st.st_size && mtime == st.st_mtime &&
+        ino == st.st_ino && dev == st.st_dev;
+    }
+
+    const int fd;
+    const off_t size;
+    const time_t mtime;
+    const ino_t ino;
+    const dev_t dev;
+
+    // set on every hit, cleared by the clock hand
+    mutable std::atomic<bool> referenced;
+  };
+
+public:
+  StaticFileCache();
+
+  /**
+   * Find or open a regular file. Returns null if it does not exist or
+   * cannot be opened.
+   */
+  EntryPtr find(const std::string &path);
+
+private:
+  void erase(const std::string &path);
+  void evictLocked();
+
+  ReadWriteMutex m_mutex;
+  StringToEntryPtrMap m_files;
+  std::string m_hand; // key the clock sweep resumes from
+
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // incl_HPHP_STATIC_FILE_CACHE_H_
@@ -808,6 +808,57 @@ void Transport::sendRaw(void *data, int size, int code /* = 200 */,
   sendRawLocked(data, size, code, compressed, chunked, codeInfo);
 }
 
+static bool read_file(int fd, off_t offset, int size, std::string &out) {
+  out.resize(size);
+  int total = 0;
+  while (total < size) {
+    ssize_t n = pread(fd, &out[total], size - total, offset + total);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    total += n;
+  }
+  return true;
+}
+
+void Transport::sendFile(int fd, off_t offset, int size,
+                         int code /* = 200 */,
+                         bool compressed /* = false */) {
+  if (m_headerSent || m_chunkedEncoding || !m_headerCallback.isNull() ||
+      (!compressed && RuntimeOption::ForceChunkedEncoding) ||
+      // there is no body in memory to check a Content-MD5 header against
+      m_responseHeaders.find("Content-MD5") != m_responseHeaders.end() ||
+      !canSendFile()) {
+    std::string data;
+    if (!read_file(fd, offset, size, data)) {
+      Logger::Warning("Unable to read %d bytes of static file: %s",
+                      size, Util::safe_strerror(errno).c_str());
+      sendStringLocked("", 500, false, false, "Unable to read file");
+      return;
+    }
+    sendRaw((void*)data.data(), data.size(), code, compressed);
+    return;
+  }
+
+  ServerStatsHelper ssh("send");
+  if (m_responseCode < 0) {
+    m_responseCode = code;
+    m_responseCodeInfo = "";
+  }
+  prepareHeaders(compressed, false, String(), String());
+  m_headerSent = true;
+
+  m_responseSize += size;
+  ServerStats::SetThreadMode(ServerStats::ThreadMode::Writing);
+  sendFileImpl(fd, offset, size, m_responseCode);
+  ServerStats::SetThreadMode(ServerStats::ThreadMode::Processing);
+
+  ServerStats::LogBytes(size);
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    ServerStats::Log("network.uncompressed", size);
+    ServerStats::Log("network.compressed", size);
+  }
+}
+
 void Transport::onSendEnd() {
   if (m_compressor && m_chunkedEncoding) {
     bool compressed = false;
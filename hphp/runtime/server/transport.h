@@ -200,6 +200,14 @@ public:
    */
   virtual void onSendEndImpl() {}
 
+  /**
+   * Override to write a response body straight from a file. sendFile()
+   * only calls sendFileImpl() when canSendFile() says yes, after all
+   * headers are prepared.
+   */
+  virtual bool canSendFile() { return false; }
+  virtual void sendFileImpl(int fd, off_t offset, int size, int code) {}
+
   /**
    * Need this implementation to break keep-alive connections.
    */
@@ -302,6 +310,13 @@ public:
   virtual void sendRaw(void *data, int size, int code = 200,
                        bool compressed = false, bool chunked = false,
                        const char *codeInfo = nullptr);
+  /**
+   * Send size bytes of fd, starting at offset, as the whole response. The
+   * caller keeps ownership of fd. Transports that cannot write from a file
+   * get its contents through sendRaw() instead.
+   */
+  void sendFile(int fd, off_t offset, int size, int code = 200,
+                bool compressed = false);
 private:
   void sendStringLocked(const char *data, int code = 200,
                         bool compressed = false, bool chunked = false,
@@ -3949,7 +3949,7 @@ inline void OPTBLD_INLINE VMExecutionContext::iopFatal(PC& pc) {
 
 inline void OPTBLD_INLINE VMExecutionContext::jmpSurpriseCheck(Offset offset) {
   if (offset <= 0 && UNLIKELY(Transl::TargetCache::loadConditionFlags())) {
-    EventHook::CheckSurprise();
+    EventHook::CheckSurprise(m_fp);
   }
 }
 
@@ -3970,24 +3970,24 @@ inline void OPTBLD_INLINE VMExecutionContext::jmpOpImpl(PC& pc) {
   jmpSurpriseCheck(offset);
 
   Cell* c1 = m_stack.topC();
+  bool taken;
   if (c1->m_type == KindOfInt64 || c1->m_type == KindOfBoolean) {
     int64_t n = c1->m_data.num;
-    if (op == OpJmpZ ? n == 0 : n != 0) {
-      pc += offset - 1;
-      m_stack.popX();
-    } else {
-      pc += sizeof(Offset);
-      m_stack.popX();
-    }
+    taken = op == OpJmpZ ? n == 0 : n != 0;
+    m_stack.popX();
   } else {
     auto const condition = toBoolean(cellAsCVarRef(*c1));
-    if (op == OpJmpZ ? !condition : condition) {
-      pc += offset - 1;
-      m_stack.popC();
-    } else {
-      pc += sizeof(Offset);
-      m_stack.popC();
-    }
+    taken = op == OpJmpZ ? !condition : condition;
+    m_stack.popC();
+  }
+  if (UNLIKELY(shouldProfile())) {
+    // The region selector uses this to extend regions past biased branches.
+    recordBranch(m_fp->m_func, m_fp->m_func->unit()->offsetOf(pc - 1), taken);
+  }
+  if (taken) {
+    pc += offset - 1;
+  } else {
+    pc += sizeof(Offset);
   }
 }
 
@@ -22,6 +22,7 @@
 #include "hphp/runtime/base/complex_types.h"
 #include "hphp/runtime/ext/ext_function.h"
 #include "hphp/runtime/vm/runtime.h"
+#include "hphp/runtime/vm/stack_sampler.h"
 
 namespace HPHP {
 
@@ -48,9 +49,13 @@ void EventHook::DisableIntercept() {
   ThreadInfo::s_threadInfo->m_reqInjectionData.clearInterceptFlag();
 }
 
-ssize_t EventHook::CheckSurprise() {
+ssize_t EventHook::CheckSurprise(const ActRec* fp) {
   ThreadInfo* info = ThreadInfo::s_threadInfo.getNoCheck();
-  return check_request_surprise(info);
+  ssize_t flags = check_request_surprise(info);
+  if (flags & RequestInjectionData::ProfileSampleFlag) {
+    StackSampler::Sample(fp);
+  }
+  return flags;
 }
 
 class ExecutingSetprofileCallbackGuard {
@@ -177,7 +182,7 @@ bool EventHook::RunInterceptHandler(ActRec* ar) {
 }
 
 bool EventHook::onFunctionEnter(const ActRec* ar, int funcType) {
-  ssize_t flags = CheckSurprise();
+  ssize_t flags = CheckSurprise(ar);
   if (flags & RequestInjectionData::InterceptFlag &&
       !RunInterceptHandler(const_cast<ActRec*>(ar))) {
     return false;
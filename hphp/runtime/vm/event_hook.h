@@ -34,7 +34,11 @@ class EventHook {
   static void Disable();
   static void EnableIntercept();
   static void DisableIntercept();
-  static ssize_t CheckSurprise();
+  /*
+   * fp is the innermost frame, used if the stack sampler asked for a
+   * sample.
+   */
+  static ssize_t CheckSurprise(const ActRec* fp);
 
   /*
    * Can throw from user-defined signal handlers, or OOM or timeout
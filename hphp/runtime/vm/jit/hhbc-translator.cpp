@@ -1679,6 +1679,11 @@ SSATmp* HhbcTranslator::emitJmpCondHelper(int32_t offset,
 
   auto const target  = getExitTrace(offset);
   auto const boolSrc = gen(ConvCellToBool, src);
+  if (!m_lastBcOff && boolSrc->isConst()) {
+    // A region continuing past this jump could be left with unreachable
+    // code on the main trace if the simplifier folds it into a Jmp_.
+    PUNT(JmpCond-Const);
+  }
   gen(DecRef, src);
   return gen(negate ? JmpZero : JmpNZero, target, boolSrc);
 }
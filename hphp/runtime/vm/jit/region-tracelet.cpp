@@ -15,6 +15,8 @@
 */
 
 #include "hphp/util/trace.h"
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/vm/type_profile.h"
 #include "hphp/runtime/vm/jit/hhbc-translator.h"
 #include "hphp/runtime/vm/jit/ir-translator.h"
 #include "hphp/runtime/vm/jit/region-selection.h"
@@ -88,6 +90,20 @@ bool prepareInstruction(NormalizedInstruction& inst, State& state) {
   return true;
 }
 
+/*
+ * Returns true iff the region should continue down the fall-through side of
+ * the conditional jump inst, leaving the taken side as a side exit. We only
+ * do that when the interpreter's branch profile says the jump is almost
+ * never taken, so loop bodies and hot paths through if/else chains end up
+ * in one region instead of a chain of tracelets.
+ */
+bool followCondJmp(const Func* func, const NormalizedInstruction& inst) {
+  auto const taken = predictBranchTaken(func, inst.offset());
+  FTRACE(2, "branch profile for {}: taken {}\n", inst.toString(), taken);
+  return taken >= 0.0 &&
+    1.0 - taken >= RuntimeOption::EvalJitRegionMinBranchBias;
+}
+
 RegionDescPtr regionTraceletImpl(const RegionContext& ctx,
                                  InterpSet& toInterp) {
   IRTranslator irTrans(ctx.bcOffset, ctx.spOffset, ctx.func);
@@ -99,6 +115,7 @@ RegionDescPtr regionTraceletImpl(const RegionContext& ctx,
   };
   auto& ht = state.ht;
   uint32_t numJmps = 0;
+  uint32_t numCondJmps = 0;
 
   SrcKey sk(state.startSk);
   auto region = smart::make_unique<RegionDesc>();
@@ -141,6 +158,7 @@ RegionDescPtr regionTraceletImpl(const RegionContext& ctx,
     if (!prepareInstruction(inst, state)) return region;
 
     // Before doing the translation, check for tracelet-ending control flow.
+    bool condJmp = false;
     if (inst.op() == OpJmp && inst.imm[0].u_BA > 0 &&
         numJmps < Transl::Translator::MaxJmpsTracedThrough) {
       // Include the Jmp in the region and continue to its destination.
@@ -151,6 +169,14 @@ RegionDescPtr regionTraceletImpl(const RegionContext& ctx,
 
       ht.setBcOff(sk.offset(), false);
       continue;
+    } else if ((inst.op() == OpJmpZ || inst.op() == OpJmpNZ) &&
+               !toInterp.count(sk) &&
+               numCondJmps < RuntimeOption::EvalJitRegionMaxCondJmps &&
+               followCondJmp(curFunc, inst)) {
+      // Translated below like any other instruction; the fall-through
+      // starts a new block.
+      ++numCondJmps;
+      condJmp = true;
     } else if (Transl::opcodeBreaksBB(inst.op()) ||
                (Transl::dontGuardAnyInputs(inst.op()) &&
                 Transl::opcodeChangesPC(inst.op()))) {
@@ -185,6 +211,7 @@ RegionDescPtr regionTraceletImpl(const RegionContext& ctx,
 
     addInstruction();
     sk.advance(curBlock->unit());
+    if (condJmp) blockFinished = true;
   }
 }
 }
@@ -85,6 +85,7 @@ void SrcRec::newTranslation(TCA newStart) {
   TRACE(1, "SrcRec(%p)::newTranslation @%p, ", this, newStart);
 
   m_translations.push_back(newStart);
+  atomic_release_store(&m_numTranslations, m_translations.size());
   if (!m_topTranslation) {
     atomic_release_store(&m_topTranslation, newStart);
     patchIncomingBranches(newStart);
@@ -154,6 +155,7 @@ void SrcRec::replaceOldTranslations() {
   // Everyone needs to give up on old translations; send them to the anchor,
   // which is a REQ_RETRANSLATE.
   m_translations.clear();
+  atomic_release_store(&m_numTranslations, size_t(0));
   m_tailFallbackJumps.clear();
   atomic_release_store(&m_topTranslation, static_cast<TCA>(0));
 
@@ -77,6 +77,7 @@ private:
 struct SrcRec {
   SrcRec()
     : m_topTranslation(nullptr)
+    , m_numTranslations(0)
     , m_anchorTranslation(0)
     , m_dbgBranchGuardSrc(nullptr)
   {}
@@ -111,6 +112,14 @@ struct SrcRec {
     return m_translations;
   }
 
+  /*
+   * translations().size(), for threads that don't hold the write lease
+   * (e.g. while analyzing a tracelet).
+   */
+  size_t numTranslations() const {
+    return atomic_acquire_load(&m_numTranslations);
+  }
+
   /*
    * The anchor translation is a retranslate request for the current
    * SrcKey that will continue the tracelet chain.
@@ -139,6 +148,8 @@ private:
   // translations vector, or if hasDebuggerGuard() it points to the
   // debug guard.  Read/write with atomic primitives only.
   TCA m_topTranslation;
+  // Mirrors m_translations.size(); read/write with atomic primitives only.
+  size_t m_numTranslations;
 
   /*
    * The following members are all protected by the translator write
@@ -63,6 +63,7 @@
 #include "hphp/util/util.h"
 #include "hphp/util/repo_schema.h"
 #include "hphp/util/cycles.h"
+#include "hphp/util/lock.h"
 
 #include "hphp/runtime/vm/bytecode.h"
 #include "hphp/runtime/vm/php_debug.h"
@@ -579,6 +580,71 @@ asm_label(a, release);
 }
 
 
+/*
+ * Marks a SrcKey as being analyzed or translated by one thread, from
+ * before it takes the write lease until it is done, so that other threads
+ * reaching the same SrcKey meanwhile interpret it rather than analyze or
+ * translate it again. That includes the thread holding the lease.
+ */
+class TranslatorX64::SrcKeyClaim {
+ public:
+  SrcKeyClaim() : m_claimed(false) {}
+  ~SrcKeyClaim() {
+    if (m_claimed) {
+      SimpleLock lock(s_lock);
+      s_claimed.erase(m_sk);
+    }
+  }
+
+  bool claim(SrcKey sk) {
+    assert(!m_claimed);
+    SimpleLock lock(s_lock);
+    if (!s_claimed.insert(sk).second) return false;
+    m_sk = sk;
+    return m_claimed = true;
+  }
+
+ private:
+  static SimpleMutex s_lock;
+  static hphp_hash_set<SrcKey, SrcKey::Hasher> s_claimed;
+
+  SrcKey m_sk;
+  bool m_claimed;
+};
+
+SimpleMutex TranslatorX64::SrcKeyClaim::s_lock(false /*reentrant*/, RankLeaf);
+hphp_hash_set<SrcKey, SrcKey::Hasher> TranslatorX64::SrcKeyClaim::s_claimed;
+
+/*
+ * Analyzing a tracelet only reads bytecode and this thread's live types,
+ * so a thread that doesn't hold the write lease yet does it first, while
+ * another thread may be generating code, and then holds the lease only for
+ * code generation and publishing the result. The lease is still only
+ * tried, never waited for: a thread that loses the race throws its
+ * analysis away and interprets. To keep that rare, nothing is analyzed
+ * while the lease is visibly taken.
+ *
+ * Returns false, without analyzing, if the lease can't be had right now or
+ * another thread is already working on args.m_sk.
+ */
+bool TranslatorX64::analyzeBeforeLease(TranslArgs& args, SrcKeyClaim& claim,
+                                       std::unique_ptr<Tracelet>& tracelet) {
+  if (args.m_tracelet) return true;
+  if (!s_writeLease.couldAcquire()) {
+    SKTRACE(1, args.m_sk, "write lease is taken, not analyzing\n");
+    return false;
+  }
+  // Claim even when we already own the lease: another thread may have
+  // claimed args.m_sk and be about to translate it.
+  if (!claim.claim(args.m_sk)) {
+    SKTRACE(1, args.m_sk, "already being translated by another thread\n");
+    return false;
+  }
+  tracelet = analyze(args.m_sk);
+  args.tracelet(tracelet.get());
+  return true;
+}
+
 TCA TranslatorX64::retranslate(const TranslArgs& args) {
   if (isDebuggerAttachedProcess() && isSrcKeyInBL(curUnit(), args.m_sk)) {
     // We are about to translate something known to be blacklisted by
@@ -586,10 +652,14 @@ TCA TranslatorX64::retranslate(const TranslArgs& args) {
     SKTRACE(1, args.m_sk, "retranslate abort due to debugger\n");
     return nullptr;
   }
+  TranslArgs targs(args);
+  SrcKeyClaim claim;
+  std::unique_ptr<Tracelet> tracelet;
+  if (!analyzeBeforeLease(targs, claim, tracelet)) return nullptr;
   LeaseHolder writer(s_writeLease);
   if (!writer) return nullptr;
   SKTRACE(1, args.m_sk, "retranslate\n");
-  return translate(args);
+  return translate(targs);
 }
 
 // Only use comes from HHIR's cgExitTrace() case TraceExitType::SlowNoProgress
@@ -706,7 +776,7 @@ TranslatorX64::getTranslation(const TranslArgs& args) {
 int
 TranslatorX64::numTranslations(SrcKey sk) const {
   if (const SrcRec* sr = m_srcDB.find(sk)) {
-    return sr->translations().size();
+    return sr->numTranslations();
   }
   return 0;
 }
@@ -762,8 +832,12 @@ TranslatorX64::createTranslation(const TranslArgs& args) {
    * lottery at the dawn of time. Hopefully lots of requests won't require
    * any new translation.
    */
+  TranslArgs targs(args);
+  SrcKeyClaim claim;
+  std::unique_ptr<Tracelet> tracelet;
+  if (!analyzeBeforeLease(targs, claim, tracelet)) return nullptr;
   auto retransl = [&] {
-    return retranslate(args);
+    return retranslate(targs);
   };
   auto sk = args.m_sk;
   LeaseHolder writer(s_writeLease);
@@ -3152,8 +3226,10 @@ void dumpTranslationInfo(const Tracelet& t, TCA postGuards) {
 void
 TranslatorX64::translateWork(const TranslArgs& args) {
   auto sk = args.m_sk;
-  std::unique_ptr<Tracelet> tp = analyze(sk);
-  Tracelet& t = *tp;
+  std::unique_ptr<Tracelet> tp;
+  if (!args.m_tracelet) tp = analyze(sk);
+  Tracelet& t = args.m_tracelet ? *args.m_tracelet : *tp;
+  assert(t.m_sk == sk);
 
   SKTRACE(1, sk, "translateWork\n");
   assert(m_srcDB.find(sk));
@@ -465,6 +465,9 @@ public:
     smash(a, src, dest, true);
   }
 
+  class SrcKeyClaim;
+  bool analyzeBeforeLease(TranslArgs& args, SrcKeyClaim& claim,
+                          std::unique_ptr<Tracelet>& tracelet);
   TCA getTranslation(const TranslArgs& args);
   TCA createTranslation(const TranslArgs& args);
   TCA retranslate(const TranslArgs& args);
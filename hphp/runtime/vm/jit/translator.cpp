@@ -65,6 +65,7 @@ TRACE_SET_MOD(trans)
 static __thread BiasedCoin *dbgTranslateCoin;
 Translator* transl;
 Lease Translator::s_writeLease;
+__thread int Translator::s_analysisDepth;
 
 struct TraceletContext {
   TraceletContext() = delete;
@@ -426,8 +427,8 @@ static RuntimeType bitOpType(DynLocation* a, DynLocation* b) {
   return RuntimeType(inferType(BitOpRules, ins));
 }
 
-static uint32_t m_w = 1;    /* must not be zero */
-static uint32_t m_z = 1;    /* must not be zero */
+static __thread uint32_t m_w = 1;    /* must not be zero */
+static __thread uint32_t m_z = 1;    /* must not be zero */
 
 static uint32_t get_random()
 {
@@ -3131,7 +3132,7 @@ void Translator::analyzeCallee(TraceletContext& tas,
   auto const oldFP = vmfp();
   auto const oldSP = vmsp();
   auto const oldPC = vmpc();
-  auto const oldAnalyzeCalleeDepth = m_analysisDepth++;
+  auto const oldAnalyzeCalleeDepth = s_analysisDepth++;
   vmpc() = nullptr; // should never be used
   vmsp() = nullptr; // should never be used
   vmfp() = reinterpret_cast<Cell*>(&fakeAR);
@@ -3139,7 +3140,7 @@ void Translator::analyzeCallee(TraceletContext& tas,
     vmfp() = oldFP;
     vmsp() = oldSP;
     vmpc() = oldPC;
-    m_analysisDepth = oldAnalyzeCalleeDepth;
+    s_analysisDepth = oldAnalyzeCalleeDepth;
   };
   SCOPE_EXIT {
     // It's ok to restoreFrame() twice---we have it in this scope
@@ -3545,7 +3546,6 @@ breakBB:
 Translator::Translator()
   : m_resumeHelper(nullptr)
   , m_createdTime(Timer::GetCurrentTimeMicros())
-  , m_analysisDepth(0)
 {
   initInstrInfo();
 }
@@ -674,6 +674,7 @@ struct TranslArgs {
       , m_src(nullptr)
       , m_align(align)
       , m_interp(false)
+      , m_tracelet(nullptr)
     {}
 
   TranslArgs& sk(const SrcKey& sk) {
@@ -692,11 +693,17 @@ struct TranslArgs {
     m_interp = interp;
     return *this;
   }
+  // An analysis of m_sk the caller already did; it still owns it.
+  TranslArgs& tracelet(Tracelet* t) {
+    m_tracelet = t;
+    return *this;
+  }
 
   SrcKey m_sk;
   TCA m_src;
   bool m_align;
   bool m_interp;
+  Tracelet* m_tracelet;
 };
 
 /*
@@ -921,7 +928,9 @@ protected:
   bool isSrcKeyInBL(const Unit* unit, const SrcKey& sk);
 
 private:
-  int m_analysisDepth;
+  // Per thread, since threads analyze tracelets before they take the
+  // write lease.
+  static __thread int s_analysisDepth;
 
 public:
   void clearDbgBL();
@@ -937,8 +946,8 @@ public:
   }
 
   int analysisDepth() const {
-    assert(m_analysisDepth >= 0);
-    return m_analysisDepth;
+    assert(s_analysisDepth >= 0);
+    return s_analysisDepth;
   }
 
   // Async hook for file modifications.
@@ -14,6 +14,7 @@
    +----------------------------------------------------------------------+
 */
 
+#include "hphp/runtime/base/hphp_array.h"
 #include "hphp/runtime/base/strings.h"
 #include "hphp/runtime/vm/member_operations.h"
 #include "hphp/runtime/vm/jit/hhbc-translator.h"
@@ -1501,11 +1502,20 @@ static inline TypedValue* checkedGet(ArrayData* a, int64_t key) {
   not_reached();
 }
 
+static inline TypedValue* uncheckedGet(ArrayData* a, StringData* key) {
+  return a->nvGet(key);
+}
+
+static inline TypedValue* uncheckedGet(ArrayData* a, int64_t key) {
+  TypedValue* ret = HphpArray::NvGetIntVecFast(a, key);
+  return LIKELY(ret != nullptr) ? ret : a->nvGet(key);
+}
+
 template<KeyType keyType, bool checkForInt>
 static inline TypedValue arrayGetImpl(
   ArrayData* a, typename KeyTypeTraits<keyType>::rawType key) {
   TypedValue* ret = checkForInt ? checkedGet(a, key)
-                                : a->nvGet(key);
+                                : uncheckedGet(a, key);
   if (ret) {
     ret = tvToCell(ret);
     tvRefcountedIncRef(ret);
@@ -1947,6 +1957,17 @@ static inline ArrayData* checkedSet(ArrayData* a, int64_t key,
   not_reached();
 }
 
+static inline ArrayData* uncheckedSet(ArrayData* a, StringData* key,
+                                      CVarRef value, bool copy) {
+  return a->set(key, value, copy);
+}
+
+static inline ArrayData* uncheckedSet(ArrayData* a, int64_t key,
+                                      CVarRef value, bool copy) {
+  if (LIKELY(HphpArray::SetIntVecFast(a, key, *value.asCell()))) return a;
+  return a->set(key, value, copy);
+}
+
 template<KeyType keyType, bool checkForInt, bool setRef>
 static inline typename ShuffleReturn<setRef>::return_type arraySetImpl(
     ArrayData* a, typename KeyTypeTraits<keyType>::rawType key,
@@ -1955,7 +1976,7 @@ static inline typename ShuffleReturn<setRef>::return_type arraySetImpl(
                 "KeyType::Any is not supported in arraySetMImpl");
   const bool copy = a->getCount() > 1;
   ArrayData* ret = checkForInt ? checkedSet(a, key, value, copy)
-                               : a->set(key, value, copy);
+                               : uncheckedSet(a, key, value, copy);
 
   return arrayRefShuffle<setRef>(a, ret, setRef ? ref->tv() : nullptr);
 }
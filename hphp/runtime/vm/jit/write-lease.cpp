@@ -62,6 +62,14 @@ Lease::gremlinUnlockImpl() {
   }
 }
 
+bool Lease::couldAcquire() const {
+  if (amOwner()) {
+    return true;
+  }
+  int64_t expireDiff = m_hintExpire - Timer::GetCurrentTimeMicros();
+  return !m_held && !(expireDiff > 0 && m_owner != pthread_self());
+}
+
 // acquire: also returns true if we are already the writer.
 bool Lease::acquire(bool blocking /* = false */ ) {
   if (amOwner()) {
@@ -56,6 +56,9 @@ struct Lease {
   bool amOwner() const;
   // acquire: also returns true if we are already the writer.
   bool acquire(bool blocking = false);
+  // couldAcquire: false if acquire(false) would certainly fail right now,
+  // without touching the mutex.
+  bool couldAcquire() const;
   void drop(int64_t hintExpireDelay = 0);
 
   /*
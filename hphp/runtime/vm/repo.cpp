@@ -157,6 +157,159 @@ bool Repo::GetFileHashStmt::get(const char *path, MD5& md5) {
   return false;
 }
 
+void Repo::InsertBuildKeyStmt::insert(RepoTxn& txn, const StringData* path,
+                                      const MD5& md5, const MD5& key) {
+  if (!prepared()) {
+    std::stringstream ssInsert;
+    ssInsert << "INSERT OR REPLACE INTO "
+             << m_repo.table(m_repoId, "BuildKey")
+             << " VALUES(@path, @md5, @key);";
+    txn.prepare(*this, ssInsert.str());
+  }
+  RepoTxnQuery query(txn, *this);
+  query.bindStaticString("@path", path);
+  query.bindMd5("@md5", md5);
+  query.bindMd5("@key", key);
+  query.exec();
+}
+
+bool Repo::GetBuildKeyStmt::get(const char* path, MD5& md5, MD5& key) {
+  try {
+    RepoTxn txn(m_repo);
+    if (!prepared()) {
+      std::stringstream ssSelect;
+      ssSelect << "SELECT md5, key FROM "
+               << m_repo.table(m_repoId, "BuildKey")
+               << " WHERE path == @path;";
+      txn.prepare(*this, ssSelect.str());
+    }
+    RepoTxnQuery query(txn, *this);
+    query.bindText("@path", path, strlen(path));
+    query.step();
+    if (!query.row()) {
+      return false;
+    }
+    query.getMd5(0, md5);
+    query.getMd5(1, key);
+    txn.commit();
+    return true;
+  } catch (RepoExc& re) {
+    return false;
+  }
+  return false;
+}
+
+void Repo::clearBuildKeys(int repoId, RepoTxn& txn) {
+  txn.exec("DELETE FROM " + table(repoId, "BuildKey") + ";");
+}
+
+// Every table that stores per-unit rows, keyed by unitSn.
+static const char* kUnitTables[] = {
+  "UnitLitstr", "UnitArray", "UnitMergeables", "UnitSourceLoc",
+  "PreClass", "Func",
+};
+
+void Repo::removeUnit(int repoId, const MD5& md5, RepoTxn& txn) {
+  int64_t unitSn;
+  {
+    RepoStmt stmt(*this);
+    txn.prepare(stmt, "SELECT unitSn FROM " + table(repoId, "Unit") +
+                      " WHERE md5 == @md5;");
+    RepoTxnQuery query(txn, stmt);
+    query.bindMd5("@md5", md5);
+    query.step();
+    if (!query.row()) return;
+    query.getInt64(0, unitSn);
+  }
+
+  auto remove = [&](const char* name) {
+    RepoStmt del(*this);
+    txn.prepare(del, "DELETE FROM " + table(repoId, name) +
+                     " WHERE unitSn == @unitSn;");
+    RepoTxnQuery delQuery(txn, del);
+    delQuery.bindInt64("@unitSn", unitSn);
+    delQuery.exec();
+  };
+  remove("Unit");
+  for (auto name : kUnitTables) {
+    remove(name);
+  }
+
+  // Drop the file hashes too, so the units emitted in place of this one can
+  // record them again.
+  RepoStmt del(*this);
+  txn.prepare(del, "DELETE FROM " + table(repoId, "FileMd5") +
+                   " WHERE md5 == @md5;");
+  RepoTxnQuery delQuery(txn, del);
+  delQuery.bindMd5("@md5", md5);
+  delQuery.exec();
+}
+
+void Repo::purgeStaleUnits(int repoId) {
+  try {
+    RepoTxn txn(*this);
+    auto fileMd5 = table(repoId, "FileMd5");
+    auto unit = table(repoId, "Unit");
+    txn.exec("DELETE FROM " + fileMd5 + " WHERE rowid IN"
+             " (SELECT f.rowid FROM " + fileMd5 + " AS f LEFT JOIN " +
+             table(repoId, "BuildKey") + " AS b"
+             " ON f.path == b.path AND f.md5 == b.md5"
+             " WHERE b.path IS NULL);");
+    txn.exec("DELETE FROM " + unit + " WHERE md5 NOT IN"
+             " (SELECT md5 FROM " + fileMd5 + ");");
+    for (auto name : kUnitTables) {
+      txn.exec("DELETE FROM " + table(repoId, name) +
+               " WHERE unitSn NOT IN (SELECT unitSn FROM " + unit + ");");
+    }
+    txn.commit();
+  } catch (RepoExc& re) {
+    TRACE(0, "Failed to purge stale units from '%s': %s\n",
+             repoName(repoId).c_str(), re.msg().c_str());
+  }
+}
+
+void Repo::preloadStaticStrings() {
+  if (m_dbc == nullptr) {
+    return;
+  }
+  for (int repoId = RepoIdCount - 1; repoId >= 0; --repoId) {
+    try {
+      RepoTxn txn(*this);
+      auto litstr = table(repoId, "UnitLitstr");
+
+      // Size the table for all of them first, so that interning them in
+      // the second pass never overflows it.
+      RepoStmt countStmt(*this);
+      txn.prepare(countStmt,
+                  "SELECT COUNT(DISTINCT litstr) FROM " + litstr + ";");
+      RepoTxnQuery countQuery(txn, countStmt);
+      countQuery.step();
+      int64_t count = 0;
+      if (countQuery.row()) {
+        countQuery.getInt64(0, count);
+      }
+      StringData::ReserveStaticStrings(count);
+
+      RepoStmt stmt(*this);
+      txn.prepare(stmt, "SELECT DISTINCT litstr FROM " + litstr + ";");
+      RepoTxnQuery query(txn, stmt);
+      do {
+        query.step();
+        if (query.row()) {
+          StringData* sd;
+          query.getStaticString(0, sd);
+        }
+      } while (!query.done());
+      txn.commit();
+      TRACE(1, "Repo preloaded %" PRId64 " static strings from '%s'\n",
+               count, repoName(repoId).c_str());
+    } catch (RepoExc& re) {
+      TRACE(1, "Failed to preload static strings from '%s': %s\n",
+               repoName(repoId).c_str(), re.msg().c_str());
+    }
+  }
+}
+
 bool Repo::findFile(const char *path, const string &root, MD5& md5) {
   if (m_dbc == nullptr) {
     return false;
@@ -670,6 +823,12 @@ bool Repo::createSchema(int repoId) {
                << "(path TEXT, md5 BLOB, UNIQUE(path, md5));";
       txn.exec(ssCreate.str());
     }
+    {
+      std::stringstream ssCreate;
+      ssCreate << "CREATE TABLE " << table(repoId, "BuildKey")
+               << "(path TEXT PRIMARY KEY, md5 BLOB, key BLOB);";
+      txn.exec(ssCreate.str());
+    }
     m_urp.createSchema(repoId, txn);
     m_pcrp.createSchema(repoId, txn);
     m_frp.createSchema(repoId, txn);
@@ -84,7 +84,9 @@ class Repo : public RepoProxy {
 #define RP_GOP(o) RP_OP(Get##o, get##o)
 #define RP_OPS \
   RP_IOP(FileHash) \
-  RP_GOP(FileHash)
+  RP_GOP(FileHash) \
+  RP_IOP(BuildKey) \
+  RP_GOP(BuildKey)
   class InsertFileHashStmt : public RepoProxy::Stmt {
     public:
       InsertFileHashStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
@@ -95,6 +97,20 @@ class Repo : public RepoProxy {
       GetFileHashStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
       bool get(const char* path, MD5& md5);
   };
+  // The offline compiler records, for every file it emits, the md5 of the
+  // file together with a key covering everything the emitted unit was
+  // derived from.  An incremental build reuses the unit when both match.
+  class InsertBuildKeyStmt : public RepoProxy::Stmt {
+    public:
+      InsertBuildKeyStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
+      void insert(RepoTxn& txn, const StringData* path, const MD5& md5,
+                  const MD5& key);
+  };
+  class GetBuildKeyStmt : public RepoProxy::Stmt {
+    public:
+      GetBuildKeyStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
+      bool get(const char* path, MD5& md5, MD5& key);
+  };
 #define RP_OP(c, o) \
  public: \
   c##Stmt& o(int repoId) { return *m_##o[repoId]; } \
@@ -119,6 +135,20 @@ class Repo : public RepoProxy {
                   RepoTxn& txn); // nothrow
   void commitUnit(UnitEmitter* ue, UnitOrigin unitOrigin); // nothrow
 
+  // Incremental offline builds.  clearBuildKeys() forgets the keys of the
+  // previous build, removeUnit() drops the unit with the given md5 and its
+  // file hashes so it can be emitted again, and purgeStaleUnits() drops
+  // every file hash and unit that the recorded build keys no longer refer
+  // to.
+  void clearBuildKeys(int repoId, RepoTxn& txn);
+  void removeUnit(int repoId, const MD5& md5, RepoTxn& txn);
+  void purgeStaleUnits(int repoId);
+
+  // Intern every literal string in the repo, in a static string table
+  // sized for all of them up front. Only meaningful in RepoAuthoritative
+  // mode, where the repo holds exactly the units that will run.
+  void preloadStaticStrings();
+
   // All database table names use the schema ID (md5 checksum based on the
   // source code) as a suffix.  For example, if the schema ID is
   // "b02c58478ce89719782fea89f3009295", the file magic is stored in the
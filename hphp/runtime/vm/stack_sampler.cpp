@@ -0,0 +1,345 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include "hphp/runtime/vm/stack_sampler.h"
+#include "hphp/runtime/base/execution_context.h"
+#include "hphp/runtime/base/types.h"
+#include "hphp/runtime/vm/bytecode.h"
+#include "hphp/runtime/vm/func.h"
+#include "hphp/util/hash.h"
+#include "hphp/util/lock.h"
+#include "hphp/util/logger.h"
+#include "hphp/util/process.h"
+
+#include "folly/Conv.h"
+
+#include <algorithm>
+#include <atomic>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+// older glibc headers only spell the thread id through the union
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace HPHP {
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const int kMaxDepth = 128;
+const uint32_t kTableSize = 4096; // must be a power of two
+const uint32_t kMaxProbe = 16;
+
+struct SampleEntry {
+  SampleEntry() : hash(0), count(0) {}
+
+  uint64_t hash;  // 0 means empty
+  uint64_t count;
+  std::string stack;
+};
+
+/*
+ * The samples taken on one thread. The owning thread takes the lock once
+ * per sample, so it is almost never contended; Report() and Clear() take
+ * it to read or free the table from another thread. At most kTableSize
+ * distinct stacks are kept per thread, and their strings are released by
+ * Clear().
+ *
+ * The tables are linked on s_threads, under s_threadsLock. When a thread
+ * exits, its counts are folded into s_retired and its table is unlinked
+ * and freed. Always take s_threadsLock before a table's lock.
+ */
+struct ThreadSamples {
+  ThreadSamples() : prev(nullptr), next(nullptr), lock(false), overflow(0) {}
+
+  void reset() {
+    for (auto& e : entries) {
+      e.hash = 0;
+      e.count = 0;
+      std::string().swap(e.stack);
+    }
+    overflow = 0;
+  }
+
+  ThreadSamples* prev;
+  ThreadSamples* next;
+  SimpleMutex lock;
+  uint64_t overflow;  // samples that found no free entry
+  SampleEntry entries[kTableSize];
+};
+
+/*
+ * A timer on the CPU clock of one thread, delivering SIGPROF to that
+ * thread only. Unlike ITIMER_PROF this leaves the process-wide timer to
+ * the CPU profiler, and a thread that is not running costs nothing.
+ */
+struct ThreadTimer {
+  timer_t id;
+  ThreadTimer* prev;
+  ThreadTimer* next;
+};
+
+Mutex s_threadsLock;
+ThreadSamples* s_threads; // guarded by s_threadsLock
+// Counts left behind by threads that have exited, guarded by s_threadsLock.
+hphp_hash_map<std::string, uint64_t, string_hash> s_retired;
+uint64_t s_retiredOverflow;
+std::atomic<int> s_intervalUs(0);
+Mutex s_timerLock;
+ThreadTimer* s_timers; // guarded by s_timerLock
+
+__thread ssize_t* t_conditionFlags;
+__thread ThreadSamples* t_samples;
+__thread ThreadTimer* t_timer;
+__thread bool t_timerFailed;
+
+void onProfileSignal(int) {
+  if (ssize_t* flags = t_conditionFlags) {
+    __sync_fetch_and_or(flags, RequestInjectionData::ProfileSampleFlag);
+  }
+}
+
+bool setTimer(timer_t id, int intervalUs) {
+  struct itimerspec ts;
+  ts.it_interval.tv_sec = intervalUs / 1000000;
+  ts.it_interval.tv_nsec = (intervalUs % 1000000) * 1000;
+  ts.it_value = ts.it_interval;
+  return timer_settime(id, 0, &ts, nullptr) == 0;
+}
+
+ThreadSamples* threadSamples() {
+  ThreadSamples* ts = t_samples;
+  if (UNLIKELY(!ts)) {
+    ts = t_samples = new ThreadSamples;
+    Lock lock(s_threadsLock);
+    ts->next = s_threads;
+    if (s_threads) s_threads->prev = ts;
+    s_threads = ts;
+  }
+  return ts;
+}
+
+void foldStack(const Func* const* funcs, int depth, bool truncated,
+               std::string& out) {
+  if (truncated) out = "(truncated)";
+  for (int i = depth - 1; i >= 0; --i) {
+    if (!out.empty()) out += ';';
+    const Func* func = funcs[i];
+    if (func->isPseudoMain()) {
+      out += "run_init::";
+      out += func->unit()->filepath()->data();
+    } else {
+      out += func->fullName()->data();
+    }
+  }
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool StackSampler::Start(int intervalUs) {
+  if (intervalUs <= 0) return false;
+  Lock lock(s_timerLock);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onProfileSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, nullptr) != 0) {
+    Logger::Error("StackSampler: unable to install SIGPROF handler: %s",
+                  strerror(errno));
+    return false;
+  }
+
+  for (ThreadTimer* t = s_timers; t; t = t->next) {
+    if (!setTimer(t->id, intervalUs)) {
+      Logger::Error("StackSampler: unable to start profiling timer: %s",
+                    strerror(errno));
+      return false;
+    }
+  }
+  s_intervalUs.store(intervalUs);
+  Logger::Info("StackSampler: sampling every %d us", intervalUs);
+  return true;
+}
+
+void StackSampler::Stop() {
+  Lock lock(s_timerLock);
+  for (ThreadTimer* t = s_timers; t; t = t->next) {
+    setTimer(t->id, 0);
+  }
+  // The handler stays installed: a SIGPROF already in flight would
+  // otherwise take the default action and kill the process.
+  s_intervalUs.store(0);
+}
+
+bool StackSampler::Running() {
+  return s_intervalUs.load(std::memory_order_relaxed) > 0;
+}
+
+void StackSampler::Clear() {
+  Lock lock(s_threadsLock);
+  for (ThreadSamples* ts = s_threads; ts; ts = ts->next) {
+    SimpleLock tsLock(ts->lock);
+    ts->reset();
+  }
+  hphp_hash_map<std::string, uint64_t, string_hash>().swap(s_retired);
+  s_retiredOverflow = 0;
+}
+
+void StackSampler::RegisterThread(ssize_t* conditionFlags) {
+  t_conditionFlags = conditionFlags;
+  if (t_timer || t_timerFailed) return;
+
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_notify_thread_id = Process::GetThreadPid();
+  timer_t id;
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &id) != 0) {
+    Logger::Warning("StackSampler: unable to create profiling timer: %s",
+                    strerror(errno));
+    t_timerFailed = true;
+    return;
+  }
+
+  Lock lock(s_timerLock);
+  ThreadTimer* t = new ThreadTimer;
+  t->id = id;
+  t->prev = nullptr;
+  t->next = s_timers;
+  if (s_timers) s_timers->prev = t;
+  s_timers = t_timer = t;
+  int intervalUs = s_intervalUs.load();
+  if (intervalUs > 0) setTimer(id, intervalUs);
+}
+
+void StackSampler::UnregisterThread() {
+  t_conditionFlags = nullptr;
+  if (ThreadTimer* t = t_timer) {
+    Lock lock(s_timerLock);
+    timer_delete(t->id);
+    if (t->prev) t->prev->next = t->next;
+    else s_timers = t->next;
+    if (t->next) t->next->prev = t->prev;
+    delete t;
+    t_timer = nullptr;
+  }
+  if (ThreadSamples* ts = t_samples) {
+    {
+      Lock lock(s_threadsLock);
+      for (auto& e : ts->entries) {
+        if (e.hash) s_retired[e.stack] += e.count;
+      }
+      s_retiredOverflow += ts->overflow;
+      if (ts->prev) ts->prev->next = ts->next;
+      else s_threads = ts->next;
+      if (ts->next) ts->next->prev = ts->prev;
+    }
+    // Unlinked, so no other thread can reach it any more.
+    delete ts;
+    t_samples = nullptr;
+  }
+}
+
+void StackSampler::Sample(const ActRec* fp) {
+  if (!fp) return;
+
+  const Func* funcs[kMaxDepth];
+  int depth = 0;
+  uint64_t h = 0;
+  for (; fp && depth < kMaxDepth; fp = g_vmContext->getPrevVMState(fp)) {
+    funcs[depth++] = fp->m_func;
+    h = hash_int64_pair(h, intptr_t(fp->m_func));
+  }
+  if (!h) h = 1;
+
+  ThreadSamples* ts = threadSamples();
+  SimpleLock lock(ts->lock);
+  const std::string* stack = nullptr;
+  for (uint32_t i = 0; i < kMaxProbe; ++i) {
+    SampleEntry& e = ts->entries[(h + i) & (kTableSize - 1)];
+    if (e.hash == h) {
+      ++e.count;
+      stack = &e.stack;
+      break;
+    }
+    if (e.hash == 0) {
+      foldStack(funcs, depth, fp != nullptr, e.stack);
+      e.hash = h;
+      e.count = 1;
+      stack = &e.stack;
+      break;
+    }
+  }
+  if (!stack) {
+    ++ts->overflow;
+    return;
+  }
+
+  Profiler* profiler = ThreadInfo::s_threadInfo.getNoCheck()->m_profiler;
+  if (profiler) {
+    sample_profiler_stack(profiler, stack->c_str());
+  }
+}
+
+void StackSampler::Report(std::string& out) {
+  hphp_hash_map<std::string, uint64_t, string_hash> counts;
+  uint64_t overflow;
+  {
+    Lock lock(s_threadsLock);
+    counts = s_retired;
+    overflow = s_retiredOverflow;
+    for (ThreadSamples* ts = s_threads; ts; ts = ts->next) {
+      SimpleLock tsLock(ts->lock);
+      for (auto& e : ts->entries) {
+        if (e.hash) counts[e.stack] += e.count;
+      }
+      overflow += ts->overflow;
+    }
+  }
+
+  std::vector<std::pair<uint64_t, const std::string*>> sorted;
+  sorted.reserve(counts.size());
+  for (auto& kv : counts) {
+    sorted.emplace_back(kv.second, &kv.first);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [] (const std::pair<uint64_t, const std::string*>& a,
+                const std::pair<uint64_t, const std::string*>& b) {
+              return a.first > b.first;
+            });
+
+  for (auto& p : sorted) {
+    out += *p.second;
+    out += ' ';
+    out += folly::to<std::string>(p.first);
+    out += '\n';
+  }
+  if (overflow) {
+    out += "(overflow) " + folly::to<std::string>(overflow) + "\n";
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,85 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef incl_HPHP_VM_STACK_SAMPLER_H_
+#define incl_HPHP_VM_STACK_SAMPLER_H_
+
+#include <string>
+#include <sys/types.h>
+
+namespace HPHP {
+
+struct ActRec;
+
+/*
+ * Process-wide sampling profiler for PHP stacks.
+ *
+ * Each request thread gets a timer on its own CPU clock, so SIGPROF is
+ * delivered only to threads that are running PHP and ITIMER_PROF is left
+ * to the CPU profiler. The handler only sets ProfileSampleFlag in that
+ * thread's surprise flags; the next surprise check (a function entry or a
+ * loop back edge) walks the ActRec chain and counts the folded stack in a
+ * table the thread owns, under a lock only Report() and Clear() contend
+ * for. Nothing is added to function entry or exit when the timers are off.
+ *
+ * Stacks are folded root first with ';' between frames, which is what
+ * flame graph tools expect. A request that called xhprof_sample_enable()
+ * also gets each of its samples in the usual xhprof sample format.
+ */
+class StackSampler {
+public:
+  /*
+   * Start or stop the timer. Start returns false if the timer could not
+   * be set up.
+   */
+  static bool Start(int intervalUs);
+  static void Stop();
+  static bool Running();
+
+  /*
+   * Forget all samples taken so far and free their stacks.
+   */
+  static void Clear();
+
+  /*
+   * Called on each request thread, with the thread's condition flags, so
+   * the signal handler can find them.
+   */
+  static void RegisterThread(ssize_t* conditionFlags);
+
+  /*
+   * Called before a registered thread exits, to delete its timer and free
+   * its sample table. Its counts still show up in Report().
+   */
+  static void UnregisterThread();
+
+  /*
+   * Count the stack whose innermost frame is fp. Called from a surprise
+   * check that saw ProfileSampleFlag.
+   */
+  static void Sample(const ActRec* fp);
+
+  /*
+   * All samples from all threads, including ones that have exited since
+   * the last Clear(), one "folded;stack count" line per distinct stack,
+   * most frequent first.
+   */
+  static void Report(std::string& out);
+};
+
+}
+
+#endif
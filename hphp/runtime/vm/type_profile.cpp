@@ -16,7 +16,9 @@
 #include "hphp/runtime/vm/type_profile.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/base/stats.h"
+#include "hphp/runtime/vm/func.h"
 #include "hphp/runtime/vm/jit/translator.h"
+#include "hphp/util/repo_schema.h"
 #include "hphp/util/trace.h"
 
 #include <string.h>
@@ -95,6 +97,42 @@ static const double kMinInstances = 99.0;
 typedef ValueProfile ValueProfileLine[kLineSize];
 static ValueProfileLine* profiles;
 
+/*
+ * A profile mapped from JitProfilePath starts with this header, so that a
+ * file written by a different build (whose DataType indices or hashing may
+ * differ) is never used, and so that a restarted server can tell whether
+ * the file already holds a full warmup's worth of samples.
+ */
+struct ProfileHeader {
+  char m_magic[8];
+  char m_schema[64];
+  uint32_t m_numEntries;
+  uint32_t m_pad;
+  // Requests profiled into this file, across all the runs that wrote it.
+  uint64_t m_profiledRequests;
+};
+static const size_t kHeaderSize = 4096;
+static_assert(sizeof(ProfileHeader) <= kHeaderSize, "header too big");
+static const char kProfileMagic[8] = {'H','H','T','Y','P','R','O','F'};
+
+static ProfileHeader* header;
+static int64_t numRequests;
+
+static bool profileHeaderMatches(const ProfileHeader* h) {
+  return memcmp(h->m_magic, kProfileMagic, sizeof(kProfileMagic)) == 0 &&
+    strncmp(h->m_schema, kRepoSchemaId, sizeof(h->m_schema)) == 0 &&
+    h->m_numEntries == kNumEntries;
+}
+
+static void profileHeaderInit(ProfileHeader* h) {
+  memcpy(h->m_magic, kProfileMagic, sizeof(kProfileMagic));
+  memset(h->m_schema, 0, sizeof(h->m_schema));
+  strncpy(h->m_schema, kRepoSchemaId, sizeof(h->m_schema) - 1);
+  h->m_numEntries = kNumEntries;
+  h->m_pad = 0;
+  h->m_profiledRequests = 0;
+}
+
 static ValueProfileLine*
 profileInitMmap() {
   const std::string& path = RuntimeOption::EvalJitProfilePath;
@@ -103,7 +141,11 @@ profileInitMmap() {
   }
 
   TRACE(1, "profileInit: path %s\n", path.c_str());
-  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  // Only a recording server writes the profile; anyone else just reads
+  // what an earlier run left behind, and must not create or resize it.
+  bool record = RuntimeOption::EvalJitProfileRecord;
+  int fd = record ? open(path.c_str(), O_RDWR | O_CREAT, 0600)
+                  : open(path.c_str(), O_RDONLY);
   if (fd < 0) {
     TRACE(0, "profileInit: open %s failed: %s\n", path.c_str(),
           strerror(errno));
@@ -111,26 +153,51 @@ profileInitMmap() {
     return nullptr;
   }
 
-  size_t len = sizeof(ValueProfileLine) * kNumLines;
-  int retval = ftruncate(fd, len);
-  if (retval < 0) {
-    perror("truncate");
-    TRACE(0, "profileInit: truncate %s failed: %s\n", path.c_str(),
-          strerror(errno));
-    return nullptr;
+  size_t len = kHeaderSize + sizeof(ValueProfileLine) * kNumLines;
+  if (record) {
+    int retval = ftruncate(fd, len);
+    if (retval < 0) {
+      perror("truncate");
+      TRACE(0, "profileInit: truncate %s failed: %s\n", path.c_str(),
+            strerror(errno));
+      close(fd);
+      return nullptr;
+    }
+  } else {
+    // Mapping past the end of a short file would fault on first access.
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < len) {
+      TRACE(0, "profileInit: %s is too short, ignoring it\n", path.c_str());
+      close(fd);
+      return nullptr;
+    }
   }
 
-  int flags = PROT_READ |
-    (RuntimeOption::EvalJitProfileRecord ? PROT_WRITE : 0);
+  int flags = PROT_READ | (record ? PROT_WRITE : 0);
   void* mmapRet = mmap(0, len, flags, MAP_SHARED, // Yes, shared.
                        fd, 0);
+  close(fd);
   if (mmapRet == MAP_FAILED) {
     perror("mmap");
     TRACE(0, "profileInit: mmap %s failed: %s\n", path.c_str(),
           strerror(errno));
     return nullptr;
   }
-  return (ValueProfileLine*)mmapRet;
+
+  ProfileHeader* h = (ProfileHeader*)mmapRet;
+  if (!profileHeaderMatches(h)) {
+    if (!record) {
+      TRACE(0, "profileInit: %s is from another build, ignoring it\n",
+            path.c_str());
+      munmap(mmapRet, len);
+      return nullptr;
+    }
+    TRACE(1, "profileInit: starting a fresh profile in %s\n", path.c_str());
+    memset(mmapRet, 0, len);
+    profileHeaderInit(h);
+  }
+  header = h;
+  return (ValueProfileLine*)((char*)mmapRet + kHeaderSize);
 }
 
 void
@@ -142,6 +209,14 @@ profileInit() {
       profiles = (ValueProfileLine*)calloc(sizeof(ValueProfileLine), kNumLines);
       assert(profiles);
     }
+    // A profile saved by an earlier run of this build already has all the
+    // samples warmup would gather, so start translating immediately.
+    if (header && RuntimeOption::EvalJitProfileWarmStart &&
+        header->m_profiledRequests >= RuntimeOption::EvalJitWarmupRequests) {
+      TRACE(1, "profileInit: warm start, %" PRIu64 " profiled requests\n",
+            header->m_profiledRequests);
+      numRequests = RuntimeOption::EvalJitWarmupRequests;
+    }
   }
 }
 
@@ -155,7 +230,6 @@ profileInit() {
  * the EvalJitWarmupRequests'th req.
  */
 bool __thread profileOn = false;
-static int64_t numRequests;
 
 static inline bool warmedUp() {
   return (numRequests >= RuntimeOption::EvalJitWarmupRequests) ||
@@ -182,6 +256,9 @@ profileRequestStart() {
 
 void profileRequestEnd() {
   numRequests++; // racy RMW; ok to miss a rare few.
+  if (profileOn && header && RuntimeOption::EvalJitProfileRecord) {
+    header->m_profiledRequests++; // likewise
+  }
 }
 
 enum class KeyToVPMode {
@@ -190,7 +267,8 @@ enum class KeyToVPMode {
 
 uint64_t
 TypeProfileKey::hash() const {
-  return hash_int64_pair(m_kind, m_name->hash());
+  uint64_t h = hash_int64_pair(m_kind, m_name->hash());
+  return m_kind == BranchSite ? hash_int64_pair(h, m_offset) : h;
 }
 
 static inline ValueProfile*
@@ -294,6 +372,40 @@ PredVal predictType(TypeProfileKey key) {
   return std::make_pair(pred, maxProb);
 }
 
+/*
+ * Branch profiles live in the same table as the type profiles, keyed by
+ * the function's name and the jump's offset. Slot 0 of m_samples counts
+ * fall-throughs and slot 1 counts taken jumps.
+ */
+static TypeProfileKey branchKey(const Func* func, Offset offset) {
+  TypeProfileKey key(TypeProfileKey::BranchSite, func->fullName());
+  key.m_offset = offset;
+  return key;
+}
+
+void recordBranch(const Func* func, Offset offset, bool taken) {
+  if (!profiles) return;
+  if (!shouldProfile()) return;
+  ValueProfile *prof = keyToVP(branchKey(func, offset), KeyToVPMode::Write);
+  if (prof->m_totalSamples != kMaxCounter) {
+    prof->m_totalSamples++;
+    if (prof->m_samples[taken] < kMaxCounter) {
+      prof->m_samples[taken]++;
+    }
+  }
+}
+
+double predictBranchTaken(const Func* func, Offset offset) {
+  if (!profiles) return -1.0;
+  const ValueProfile *prof =
+    keyToVP(branchKey(func, offset), KeyToVPMode::Read);
+  if (!prof || prof->m_totalSamples < kMinInstances) return -1.0;
+  double taken = (1.0 * prof->m_samples[1]) / prof->m_totalSamples;
+  TRACE(2, "BranchPred: %s@%d numSamples %d taken %g\n",
+        func->fullName()->data(), offset, prof->m_totalSamples, taken);
+  return taken > 1.0 ? 1.0 : taken;
+}
+
 bool isProfileOpcode(const PC& pc) {
   auto const op = toOp(*pc);
   return op == OpRetC || op == OpCGetM;
@@ -22,6 +22,7 @@
 namespace HPHP {
 
 class StringData;
+class Func;
 
 
 struct TypeProfileKey {
@@ -29,15 +30,17 @@ struct TypeProfileKey {
     MethodName,
     PropName,
     EltName,
-    StaticPropName
+    StaticPropName,
+    BranchSite
   } m_kind;
   const StringData* m_name;
+  Offset m_offset; // Only meaningful for BranchSite.
 
   TypeProfileKey(KeyType kind, const StringData* sd) :
-   m_kind(kind), m_name(sd) { }
+   m_kind(kind), m_name(sd), m_offset(0) { }
 
   TypeProfileKey(MemberCode mc, const StringData* sd) :
-    m_kind(mc == MET ? EltName : PropName), m_name(sd) { }
+    m_kind(mc == MET ? EltName : PropName), m_name(sd), m_offset(0) { }
   uint64_t hash() const;
 };
 
@@ -49,6 +52,15 @@ void recordType(TypeProfileKey sk, DataType dt);
 std::pair<DataType, double> predictType(TypeProfileKey key);
 bool isProfileOpcode(const PC& pc);
 
+/*
+ * Direction profile for the conditional jump at offset in func, gathered
+ * by the interpreter alongside the type profile. predictBranchTaken
+ * returns the fraction of samples where the branch was taken, or a
+ * negative value if there are too few samples to say.
+ */
+void recordBranch(const Func* func, Offset offset, bool taken);
+double predictBranchTaken(const Func* func, Offset offset);
+
 extern __thread bool profileOn;
 inline bool shouldProfile() {
   return profileOn;
@@ -18,6 +18,7 @@
 #include "hphp/test/ext/test_parser_expr.h"
 #include "hphp/test/ext/test_parser_stmt.h"
 #include "hphp/test/ext/test_code_error.h"
+#include "hphp/test/ext/test_build_keys.h"
 #include "hphp/test/ext/test_cpp_base.h"
 #include "hphp/test/ext/test_util.h"
 #include "hphp/test/ext/test_ext.h"
@@ -52,6 +53,7 @@ void Test::RunTestsImpl(bool &allPassed, std::string &suite,
     RUN_TESTSUITE(TestParserExpr);
     RUN_TESTSUITE(TestParserStmt);
     RUN_TESTSUITE(TestCodeError);
+    RUN_TESTSUITE(TestBuildKeys);
     RUN_TESTSUITE(TestUtil);
     RUN_TESTSUITE(TestCppBase);
     return;
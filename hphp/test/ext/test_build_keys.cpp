@@ -0,0 +1,93 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include "hphp/test/ext/test_build_keys.h"
+#include "hphp/compiler/parser/parser.h"
+#include "hphp/compiler/builtin_symbols.h"
+#include "hphp/compiler/analysis/analysis_result.h"
+#include "hphp/compiler/analysis/file_scope.h"
+#include "hphp/compiler/analysis/type.h"
+#include "hphp/compiler/option.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+TestBuildKeys::TestBuildKeys() {
+}
+
+bool TestBuildKeys::RunTests(const std::string &which) {
+  bool ret = true;
+  RUN_TEST(TestCallerEdit);
+  return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Analyze callee.php together with the given caller.php the way the hhbc
+ * target does, and return both files' build keys.
+ */
+void TestBuildKeys::BuildKeys(const char *caller, MD5 &callerKey,
+                              MD5 &calleeKey) {
+  Type::ResetTypeHintTypes();
+  Type::InitTypeHintMap();
+  BuiltinSymbols::LoadSuperGlobals();
+
+  AnalysisResultPtr ar(new AnalysisResult());
+  Compiler::Parser::ParseString("<?php function callee($x) { return $x; }",
+                                ar, "callee.php");
+  Compiler::Parser::ParseString(caller, ar, "caller.php");
+  BuiltinSymbols::Load(ar);
+  if (Option::WholeProgram) {
+    ar->analyzeProgram();
+    ar->inferTypes();
+    ar->analyzeProgramFinal();
+  }
+
+  std::vector<MD5> keys;
+  ar->getBuildKeys("", keys);
+  const std::vector<FileScopePtr> &files = ar->getAllFilesVector();
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->getName() == "caller.php") callerKey = keys[i];
+    if (files[i]->getName() == "callee.php") calleeKey = keys[i];
+  }
+}
+
+bool TestBuildKeys::TestCallerEdit() {
+  const char *caller1 = "<?php callee(1);";
+  const char *caller2 = "<?php callee('one');";
+  MD5 callerKey1, calleeKey1, callerKey2, calleeKey2;
+
+  {
+    // callee's parameter type is inferred from its callers, so editing a
+    // caller has to re-emit the callee
+    WithOpt w0(Option::WholeProgram);
+    BuildKeys(caller1, callerKey1, calleeKey1);
+    BuildKeys(caller2, callerKey2, calleeKey2);
+    VERIFY(callerKey1 != callerKey2);
+    VERIFY(calleeKey1 != calleeKey2);
+  }
+
+  {
+    // without inference each file is compiled on its own
+    WithNoOpt w0(Option::WholeProgram);
+    WithNoOpt w1(Option::GenerateInferredTypes);
+    BuildKeys(caller1, callerKey1, calleeKey1);
+    BuildKeys(caller2, callerKey2, calleeKey2);
+    VERIFY(callerKey1 != callerKey2);
+    VERIFY(calleeKey1 == calleeKey2);
+  }
+  return Count(true);
+}
@@ -0,0 +1,42 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef incl_HPHP_TEST_BUILD_KEYS_H_
+#define incl_HPHP_TEST_BUILD_KEYS_H_
+
+#include "hphp/test/ext/test_base.h"
+#include "hphp/runtime/base/md5.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Testing which units an incremental hhbc build may reuse.
+ */
+class TestBuildKeys : public TestBase {
+ public:
+  TestBuildKeys();
+
+  virtual bool RunTests(const std::string &which);
+
+  bool TestCallerEdit();
+
+ private:
+  static void BuildKeys(const char *caller, MD5 &callerKey, MD5 &calleeKey);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif // incl_HPHP_TEST_BUILD_KEYS_H_
@@ -19,6 +19,7 @@
 #include "hphp/util/logger.h"
 #include "hphp/runtime/base/memory_manager.h"
 #include "hphp/runtime/base/builtin_functions.h"
+#include "hphp/runtime/base/zend_string.h"
 #include "hphp/runtime/ext/ext_variable.h"
 #include "hphp/runtime/ext/ext_apc.h"
 #include "hphp/runtime/ext/ext_mysql.h"
@@ -39,7 +40,9 @@ TestCppBase::TestCppBase() {
 bool TestCppBase::RunTests(const std::string &which) {
   bool ret = true;
   RUN_TEST(TestSmartAllocator);
+  RUN_TEST(TestMediumSizeClasses);
   RUN_TEST(TestString);
+  RUN_TEST(TestStringKernels);
   RUN_TEST(TestArray);
   RUN_TEST(TestObject);
   RUN_TEST(TestVariant);
@@ -121,6 +124,51 @@ bool TestCppBase::TestSmartAllocator() {
 ///////////////////////////////////////////////////////////////////////////////
 // data types
 
+bool TestCppBase::TestMediumSizeClasses() {
+  typedef MemoryManager MM;
+  struct Case { size_t padbytes, rounded; unsigned cls; };
+  static const Case cases[] = {
+    { MM::kMaxSmartSize + 1,  2560,               0 },
+    { 2560,                   2560,               0 },
+    { 2561,                   3072,               1 },
+    { 4096,                   4096,               3 },
+    { 4097,                   5120,               4 },
+    { MM::kMaxMediumSize - 1, MM::kMaxMediumSize, MM::kNumMediumSizes - 1 },
+    { MM::kMaxMediumSize,     MM::kMaxMediumSize, MM::kNumMediumSizes - 1 },
+  };
+  for (auto& c : cases) {
+    size_t padbytes = c.padbytes;
+    VERIFY(MM::mediumSizeClass(padbytes) == c.cls);
+    VERIFY(padbytes == c.rounded);
+  }
+
+  // Every size maps to a class whose size fits it, classes never shrink
+  // as sizes grow, and a class's own size maps back to that class.
+  unsigned last = 0;
+  for (size_t n = MM::kMaxSmartSize + 1; n <= MM::kMaxMediumSize; n += 8) {
+    size_t padbytes = n;
+    unsigned cls = MM::mediumSizeClass(padbytes);
+    VERIFY(cls < MM::kNumMediumSizes);
+    VERIFY(cls >= last);
+    VERIFY(padbytes >= n);
+    size_t rounded = padbytes;
+    VERIFY(MM::mediumSizeClass(rounded) == cls);
+    VERIFY(rounded == padbytes);
+    last = cls;
+  }
+
+  // Medium blocks are counted against the request's memory usage.
+  MemoryManager* mm = MemoryManager::TheMemoryManager();
+  int64_t before = mm->getStats().usage;
+  void* p = smart_malloc(3000);
+  VERIFY(mm->getStats().usage == before + 3072);
+  p = smart_realloc(p, 3040);
+  VERIFY(mm->getStats().usage == before + 3072);
+  smart_free(p);
+  VERIFY(mm->getStats().usage == before);
+  return Count(true);
+}
+
 bool TestCppBase::TestString() {
   // constructors
   {
@@ -207,6 +255,62 @@ bool TestCppBase::TestString() {
   return Count(true);
 }
 
+/*
+ * The zend_string kernels have vectorized paths for 16-byte blocks, so check
+ * them against plain byte loops over random inputs of every length and
+ * alignment around the block size.
+ */
+bool TestCppBase::TestStringKernels() {
+  static const char alphabet[] = "aZzA@[`{iI09 \0\'\"\\\x80\xc9\xff";
+  srand(1234);
+  char buf[128 + 16];
+  for (int iter = 0; iter < 4000; iter++) {
+    int off = iter & 15;
+    int len = rand() % 80;
+    char *s = buf + off;
+    for (int i = 0; i < len; i++) {
+      s[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    s[len] = '\0';
+
+    char *lower = string_to_lower(s, len);
+    char *upper = string_to_upper(s, len);
+    for (int i = 0; i < len; i++) {
+      VERIFY(lower[i] == (char)tolower(s[i]));
+      VERIFY(upper[i] == (char)toupper(s[i]));
+    }
+    free(lower);
+    free(upper);
+
+    int slen = len;
+    char *slashed = string_addslashes(s, slen);
+    std::string expected;
+    for (int i = 0; i < len; i++) {
+      switch (s[i]) {
+      case '\0': expected += "\\0"; break;
+      case '\'': case '"': case '\\':
+        expected += '\\';
+        expected += s[i];
+        break;
+      default: expected += s[i]; break;
+      }
+    }
+    VERIFY(std::string(slashed ? slashed : "", slen) == expected);
+    free(slashed);
+
+    for (int nlen = 1; nlen <= 4 && nlen <= len; nlen++) {
+      const char *needle = s + rand() % (len - nlen + 1);
+      const char *found = string_memnstr(s, needle, nlen, s + len);
+      const char *naive = nullptr;
+      for (const char *p = s; p + nlen <= s + len; p++) {
+        if (!memcmp(p, needle, nlen)) { naive = p; break; }
+      }
+      VERIFY(found == naive);
+    }
+  }
+  return Count(true);
+}
+
 static const StaticString s_n0("n0");
 static const StaticString s_n1("n1");
 static const StaticString s_n2("n2");
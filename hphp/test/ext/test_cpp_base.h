@@ -39,6 +39,7 @@ class TestCppBase : public TestBase {
 
   // building blocks
   bool TestSmartAllocator();
+  bool TestMediumSizeClasses();
   bool TestIpBlockMap();
 
   /**
@@ -54,6 +55,7 @@ class TestCppBase : public TestBase {
    * PHP's results.
    */
   bool TestString();
+  bool TestStringKernels();
   bool TestArray();
   bool TestObject();
   bool TestVariant();
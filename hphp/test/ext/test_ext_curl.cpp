@@ -16,6 +16,7 @@
 
 #include "hphp/test/ext/test_ext_curl.h"
 #include "hphp/runtime/ext/ext_curl.h"
+#include "hphp/runtime/ext/ext_asio.h"
 #include "hphp/runtime/ext/ext_output.h"
 #include "hphp/runtime/ext/ext_zlib.h"
 #include "hphp/runtime/server/libevent_server.h"
@@ -87,6 +88,7 @@ bool TestExtCurl::RunTests(const std::string &which) {
   RUN_TEST(test_curl_setopt);
   RUN_TEST(test_curl_setopt_array);
   RUN_TEST(test_curl_exec);
+  RUN_TEST(test_curl_exec_async);
   RUN_TEST(test_curl_getinfo);
   RUN_TEST(test_curl_errno);
   RUN_TEST(test_curl_error);
@@ -188,6 +190,28 @@ bool TestExtCurl::test_curl_exec() {
   return Count(true);
 }
 
+bool TestExtCurl::test_curl_exec_async() {
+  {
+    Variant c = f_curl_init(String(get_request_uri()));
+    f_curl_setopt(c.toResource(), k_CURLOPT_RETURNTRANSFER, true);
+    Object wh = f_curl_exec_async(c.toResource());
+    VS(static_cast<c_WaitHandle*>(wh.get())->t_join(), "OK");
+    VS(f_curl_getinfo(c.toResource(), k_CURLINFO_HTTP_CODE), 200);
+  }
+  {
+    Variant c = f_curl_init(String(get_request_uri()));
+    f_curl_setopt(c.toResource(), k_CURLOPT_WRITEFUNCTION, "curl_write_func");
+    bool thrown = false;
+    try {
+      f_curl_exec_async(c.toResource());
+    } catch (Object &e) {
+      thrown = true;
+    }
+    VERIFY(thrown);
+  }
+  return Count(true);
+}
+
 bool TestExtCurl::test_curl_getinfo() {
   Variant c = f_curl_init(String(get_request_uri()));
   f_curl_setopt(c.toResource(), k_CURLOPT_RETURNTRANSFER, true);
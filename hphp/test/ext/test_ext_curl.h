@@ -33,6 +33,7 @@ class TestExtCurl : public TestCppExt {
   bool test_curl_setopt();
   bool test_curl_setopt_array();
   bool test_curl_exec();
+  bool test_curl_exec_async();
   bool test_curl_getinfo();
   bool test_curl_errno();
   bool test_curl_error();
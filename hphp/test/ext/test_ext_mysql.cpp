@@ -84,6 +84,7 @@ bool TestExtMysql::RunTests(const std::string &which) {
   RUN_TEST(test_mysql_field_len);
   RUN_TEST(test_mysql_field_type);
   RUN_TEST(test_mysql_field_flags);
+  RUN_TEST(test_mysql_connection_pool_reset);
 
   return ret;
 }
@@ -664,3 +665,34 @@ bool TestExtMysql::test_mysql_field_flags() {
   VS(f_mysql_field_flags(res, 0), "not_null primary_key auto_increment");
   return Count(true);
 }
+
+bool TestExtMysql::test_mysql_connection_pool_reset() {
+  int savedSize = RuntimeOption::MySQLConnectionPoolSize;
+  RuntimeOption::MySQLConnectionPoolSize = 1;
+
+  // leave session state behind on a pooled connection
+  Variant conn = f_mysql_connect(TEST_HOSTNAME, TEST_USERNAME, TEST_PASSWORD,
+                                 true);
+  f_mysql_select_db(TEST_DATABASE, conn);
+  Variant threadId = f_mysql_thread_id(conn);
+  f_mysql_query("set @pool_test = 42", conn);
+  f_mysql_query("set autocommit = 0", conn);
+  f_mysql_query("create temporary table pool_test (id int)", conn);
+  f_mysql_close(conn);
+
+  // the next link gets the same connection back, without any of it
+  conn = f_mysql_connect(TEST_HOSTNAME, TEST_USERNAME, TEST_PASSWORD, true);
+  Variant reused = f_mysql_thread_id(conn);
+  Variant res = f_mysql_query("select @pool_test, @@autocommit", conn);
+  Variant row = f_mysql_fetch_row(res);
+  f_mysql_select_db(TEST_DATABASE, conn);
+  Variant temp = f_mysql_query("select * from pool_test", conn);
+  f_mysql_close(conn);
+  RuntimeOption::MySQLConnectionPoolSize = savedSize;
+
+  VS(reused, threadId);
+  VS(row[0], uninit_null());
+  VS(row[1], "1");
+  VS(temp, false);
+  return Count(true);
+}
@@ -80,6 +80,7 @@ class TestExtMysql : public TestCppExt {
   bool test_mysql_field_len();
   bool test_mysql_field_type();
   bool test_mysql_field_flags();
+  bool test_mysql_connection_pool_reset();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
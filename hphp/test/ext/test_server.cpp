@@ -26,6 +26,7 @@
 #include "hphp/runtime/ext/ext_curl.h"
 #include "hphp/runtime/ext/ext_options.h"
 #include "hphp/runtime/server/http_request_handler.h"
+#include "hphp/runtime/server/static_file_cache.h"
 #include "hphp/runtime/base/http_client.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/server/libevent_server.h"
@@ -225,6 +226,8 @@ bool TestServer::RunTests(const std::string &which) {
   RUN_TEST(TestResponseHeader);
   RUN_TEST(TestSetCookie);
   //RUN_TEST(TestRequestHandling);
+  RUN_TEST(TestStaticFileCache);
+  RUN_TEST(TestStaticFileSend);
   RUN_TEST(TestHttpClient);
   RUN_TEST(TestRPCServer);
   RUN_TEST(TestXboxServer);
@@ -464,6 +467,148 @@ bool TestServer::TestRequestHandling() {
   return Count(true);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+static void write_test_file(const char *path, const char *data) {
+  FILE *f = fopen(path, "w");
+  assert(f);
+  fputs(data, f);
+  fclose(f);
+}
+
+bool TestServer::TestStaticFileCache() {
+  const char *a = "runtime/tmp/static_a.txt";
+  const char *b = "runtime/tmp/static_b.txt";
+  const char *c = "runtime/tmp/static_c.txt";
+  const char *d = "runtime/tmp/static_d.txt";
+  write_test_file(a, "a");
+  write_test_file(b, "b");
+  write_test_file(c, "c");
+  write_test_file(d, "d");
+
+  int savedSize = RuntimeOption::StaticFileFdCacheSize;
+  RuntimeOption::StaticFileFdCacheSize = 2;
+
+  StaticFileCache cache;
+  StaticFileCache::EntryPtr a1 = cache.find(a);
+  StaticFileCache::EntryPtr a2 = cache.find(a);
+
+  // a deleted file is dropped, closing its descriptor once unused
+  unlink(a);
+  StaticFileCache::EntryPtr a3 = cache.find(a);
+  a2.reset();
+
+  // a full cache makes room for new files
+  StaticFileCache::EntryPtr b1 = cache.find(b);
+  StaticFileCache::EntryPtr c1 = cache.find(c);
+  StaticFileCache::EntryPtr d1 = cache.find(d);
+  StaticFileCache::EntryPtr d2 = cache.find(d);
+
+  RuntimeOption::StaticFileFdCacheSize = savedSize;
+  unlink(b);
+  unlink(c);
+  unlink(d);
+
+  VERIFY(a1 && a1->size == 1);
+  VERIFY(!a3);
+  VERIFY(a1.use_count() == 1);
+  VERIFY(b1 && c1 && d1);
+  VERIFY(d1 == d2);
+  VERIFY((b1.use_count() == 1) + (c1.use_count() == 1) == 1);
+  return Count(true);
+}
+
+class StaticFileTransport : public TestTransport {
+public:
+  explicit StaticFileTransport(const char *url, bool gzip)
+    : m_url(url), m_gzip(gzip), m_fd(-1), m_size(0), m_compressed(false) {}
+
+  virtual const char *getUrl() { return m_url; }
+  virtual std::string getHeader(const char *name) {
+    if (m_gzip && strcasecmp(name, "Accept-Encoding") == 0) return "gzip";
+    return "";
+  }
+  virtual void addHeaderImpl(const char *name, const char *value) {
+    if (strcasecmp(name, "Content-Encoding") == 0 &&
+        strcmp(value, "gzip") == 0) {
+      m_compressed = true;
+    }
+  }
+
+  virtual bool canSendFile() { return true; }
+  virtual void sendFileImpl(int fd, off_t offset, int size, int code) {
+    m_fd = fd;
+    m_size = size;
+    m_code = code;
+    m_response.resize(size);
+    if (pread(fd, &m_response[0], size, offset) != size) {
+      m_response.clear();
+    }
+  }
+
+  const char *m_url;
+  bool m_gzip;
+  int m_fd;
+  int m_size;
+  bool m_compressed;
+};
+
+bool TestServer::TestStaticFileSend() {
+  write_test_file("runtime/tmp/static_send.js", "var x = 1;");
+  write_test_file("runtime/tmp/static_send.js.gz", "gzipped");
+  // the sibling must not be older than the file it stands for
+  write_test_file("runtime/tmp/static_stale.js.gz", "stale");
+  sleep(1);
+  write_test_file("runtime/tmp/static_stale.js", "fresh");
+
+  std::string savedRoot = RuntimeOption::SourceRoot;
+  bool savedCache = RuntimeOption::EnableStaticContentCache;
+  bool savedDisk = RuntimeOption::EnableStaticContentFromDisk;
+  bool savedSendFile = RuntimeOption::EnableStaticContentSendFile;
+  bool savedSiblings = RuntimeOption::EnableStaticContentGzipSiblings;
+  RuntimeOption::SourceRoot = Process::GetCurrentDirectory() + "/runtime/tmp/";
+  RuntimeOption::EnableStaticContentCache = false;
+  RuntimeOption::EnableStaticContentFromDisk = true;
+  RuntimeOption::EnableStaticContentSendFile = true;
+  RuntimeOption::EnableStaticContentGzipSiblings = true;
+
+  StaticFileTransport plain("/static_send.js", false);
+  StaticFileTransport gzip("/static_send.js", true);
+  StaticFileTransport stale("/static_stale.js", true);
+  {
+    HttpRequestHandler handler;
+    handler.handleRequest(&plain);
+    handler.handleRequest(&gzip);
+    handler.handleRequest(&stale);
+  }
+
+  RuntimeOption::SourceRoot = savedRoot;
+  RuntimeOption::EnableStaticContentCache = savedCache;
+  RuntimeOption::EnableStaticContentFromDisk = savedDisk;
+  RuntimeOption::EnableStaticContentSendFile = savedSendFile;
+  RuntimeOption::EnableStaticContentGzipSiblings = savedSiblings;
+  unlink("runtime/tmp/static_send.js");
+  unlink("runtime/tmp/static_send.js.gz");
+  unlink("runtime/tmp/static_stale.js");
+  unlink("runtime/tmp/static_stale.js.gz");
+
+  VS(plain.m_code, 200);
+  VERIFY(plain.m_fd >= 0);
+  VS(plain.m_size, 10);
+  VS(String(plain.m_response), "var x = 1;");
+  VERIFY(!plain.m_compressed);
+
+  VS(gzip.m_code, 200);
+  VERIFY(gzip.m_fd >= 0);
+  VS(String(gzip.m_response), "gzipped");
+  VERIFY(gzip.m_compressed);
+
+  VS(stale.m_code, 200);
+  VS(String(stale.m_response), "fresh");
+  VERIFY(!stale.m_compressed);
+  return Count(true);
+}
+
 bool TestServer::TestLibeventServer() {
   s_server_port = find_server_port(PORT_MIN, PORT_MAX);
   return Count(true);
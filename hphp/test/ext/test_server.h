@@ -50,6 +50,10 @@ public:
   bool TestRequestHandling();
   bool TestLibeventServer();
 
+  // test serving static files from disk through sendfile
+  bool TestStaticFileCache();
+  bool TestStaticFileSend();
+
   // test inheriting server fd
   bool TestInheritFdServer();
 
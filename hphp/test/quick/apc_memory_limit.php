@@ -0,0 +1,14 @@
+<?php
+
+$value = str_repeat('x', 1024);
+$stored = 0;
+for ($i = 0; $i < 1000; $i++) {
+  if (apc_store("key$i", $value)) $stored++;
+}
+var_dump($stored);
+
+$left = 0;
+for ($i = 0; $i < 1000; $i++) {
+  if (apc_fetch("key$i") === $value) $left++;
+}
+var_dump($left > 0 && $left < 1000);
@@ -0,0 +1,28 @@
+<?php
+
+function build($n) {
+  $a = array();
+  for ($i = 0; $i < $n; $i++) {
+    $a[] = $i * 2;
+  }
+  return $a;
+}
+
+function main() {
+  foreach (array(3, 40, 300) as $n) {
+    $a = build($n);
+    $a[1] = 'one';
+    $a['k'] = 'v';
+    var_dump(count($a), $a[0], $a[1], $a[$n - 1], $a['k']);
+
+    $b = build($n);
+    $first = array_shift($b);
+    var_dump($first, count($b), $b[0], $b[$n - 2]);
+
+    $c = build($n);
+    $d = $c;
+    $d[$n + 5] = 'sparse';
+    var_dump(count($c), count($d), $d[$n + 5], isset($c[$n + 5]));
+  }
+}
+main();
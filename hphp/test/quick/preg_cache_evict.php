@@ -0,0 +1,17 @@
+<?php
+
+// With a tiny PCRE cache, compiling many distinct patterns has to evict
+// old entries instead of failing.
+$hits = 0;
+for ($i = 0; $i < 500; $i++) {
+  if (preg_match("/^item$i:(\\d+)$/", "item$i:" . ($i * 2), $m) &&
+      $m[1] == $i * 2) {
+    $hits++;
+  }
+  // keep one pattern hot across eviction rounds
+  if (!preg_match('/^hot(\d)$/', 'hot' . ($i % 10))) {
+    echo "hot pattern failed at $i\n";
+  }
+}
+echo $hits, "\n";
+var_dump(preg_replace('/item(\d+)/', 'x$1', 'item1 item499'));
@@ -0,0 +1,8 @@
+<?php
+
+$s = "plain ascii text, then \"quotes\" and a \\ and /slashes/ ".
+     "<b>&amp;</b> caf\xc3\xa9 @100%\n";
+var_dump(json_encode($s));
+var_dump(json_decode(json_encode($s)) === $s);
+var_dump(json_decode('["a long run of plain characters é \n and more", '.
+                     '{"key with spaces": "v\"q"}]', true));
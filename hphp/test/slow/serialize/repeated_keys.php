@@ -0,0 +1,20 @@
+<?php
+
+$rows = array();
+for ($i = 0; $i < 3; $i++) {
+  $rows[] = array('id' => $i, 'axb' => 'x', 'ayb' => 'y', '' => 'e');
+}
+$u = unserialize(serialize($rows));
+var_dump($u === $rows);
+$keys = array_keys($u[2]);
+$keys[1][0] = 'Z';
+var_dump($keys, array_keys($u[0]));
+
+class P {
+  public $a = 1;
+  protected $b = 2;
+  private $c = 3;
+}
+$ps = unserialize(serialize(array(new P, new P)));
+var_dump($ps[0] == $ps[1]);
+var_dump((array)$ps[1] === (array)new P);
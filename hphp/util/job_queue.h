@@ -17,6 +17,8 @@
 #ifndef incl_HPHP_UTIL_JOB_QUEUE_H_
 #define incl_HPHP_UTIL_JOB_QUEUE_H_
 
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <set>
 #include "hphp/util/async_func.h"
@@ -25,6 +27,7 @@
 #include "hphp/util/atomic.h"
 #include "hphp/util/alloc.h"
 #include "hphp/util/exception.h"
+#include "hphp/util/work_stealing_deque.h"
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -79,6 +82,18 @@ namespace HPHP {
  * want to prioritize the newest requests.
  *
  * You can configure a LIFO ordered queue by setting lifoSwitchThreshold to 0.
+ *
+ * Work stealing
+ * =============
+ * By default all workers share one deque behind the queue's mutex. With
+ * 'workStealing' set, each worker instead gets its own lock-free
+ * WorkStealingDeque; enqueue() spreads jobs over them round-robin, a worker
+ * pops its own deque first and steals from the others when it runs dry,
+ * and the mutex is only taken by workers about to go to sleep (and by
+ * producers that have to wake them up). The FIFO/LIFO switch is applied
+ * per deque against the global queue length, so ordering is only
+ * approximately FIFO/LIFO across workers. Jobs that don't fit in any deque
+ * spill into the shared deque.
  */
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -103,17 +118,29 @@ public:
    * Constructor.
    */
   JobQueue(int threadCount, bool threadRoundRobin, int dropCacheTimeout,
-           bool dropStack, int lifoSwitchThreshold=INT_MAX)
+           bool dropStack, int lifoSwitchThreshold=INT_MAX,
+           bool workStealing=false)
       : SynchronizableMulti(threadRoundRobin ? 1 : threadCount),
         m_jobCount(0), m_stopped(false), m_workerCount(0),
         m_dropCacheTimeout(dropCacheTimeout), m_dropStack(dropStack),
-        m_lifoSwitchThreshold(lifoSwitchThreshold) {
+        m_lifoSwitchThreshold(lifoSwitchThreshold),
+        m_nextDeque(0), m_idleWorkers(0), m_spilledJobs(0) {
+    if (workStealing) {
+      for (int i = 0; i < threadCount; i++) {
+        m_deques.emplace_back(
+          new WorkStealingDeque<TJob>(kWorkStealingDequeCapacity));
+      }
+    }
   }
 
   /**
    * Put a job into the queue and notify a worker to pick it up.
    */
   void enqueue(TJob job) {
+    if (!m_deques.empty()) {
+      enqueueStealing(job);
+      return;
+    }
     Lock lock(this);
     m_jobs.push_back(job);
     m_jobCount = m_jobs.size();
@@ -126,6 +153,9 @@ public:
    * the job object correctly.
    */
   TJob dequeue(int id, bool inc = false) {
+    if (!m_deques.empty()) {
+      return dequeueStealing(id, inc);
+    }
     Lock lock(this);
     bool flushed = false;
     while (m_jobs.empty()) {
@@ -193,24 +223,137 @@ public:
   }
 
  private:
-  int m_jobCount;
+  static const uint32_t kWorkStealingDequeCapacity = 1024;
+
+  bool lifoOrder() const {
+    return m_jobCount - 1 >= m_lifoSwitchThreshold;
+  }
+
+  void enqueueStealing(const TJob& job) {
+    ++m_jobCount;
+    unsigned n = m_deques.size();
+    unsigned start = m_nextDeque++;
+    for (unsigned i = 0; i < n; i++) {
+      if (m_deques[(start + i) % n]->push(job)) {
+        // Pairs with the fence in dequeueStealing(): either we see the
+        // sleeper, or the sleeper sees the job.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_idleWorkers.load(std::memory_order_relaxed)) {
+          Lock lock(this);
+          notify();
+        }
+        return;
+      }
+    }
+    Lock lock(this);
+    m_jobs.push_back(job);
+    ++m_spilledJobs;
+    notify();
+  }
+
+  /*
+   * Pop from the worker's own deque, then try to steal from the others.
+   * The active worker count goes up before the queued job count goes down
+   * so a waitable queue never looks empty while a job is in flight.
+   */
+  bool tryDequeueStealing(int id, bool inc, TJob& job) {
+    unsigned n = m_deques.size();
+    unsigned own = id % n;
+    bool lifo = lifoOrder();
+    for (unsigned i = 0; i < n; i++) {
+      auto& deque = m_deques[(own + i) % n];
+      if (lifo ? deque->popBack(job) : deque->popFront(job)) {
+        if (inc) incActiveWorker();
+        --m_jobCount;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool tryDequeueSpilled(bool inc, TJob& job) {
+    if (m_jobs.empty()) return false;
+    if (lifoOrder()) {
+      job = m_jobs.back();
+      m_jobs.pop_back();
+    } else {
+      job = m_jobs.front();
+      m_jobs.pop_front();
+    }
+    --m_spilledJobs;
+    if (inc) incActiveWorker();
+    --m_jobCount;
+    return true;
+  }
+
+  TJob dequeueStealing(int id, bool inc) {
+    TJob job;
+    if (!m_spilledJobs.load(std::memory_order_relaxed) &&
+        tryDequeueStealing(id, inc, job)) {
+      return job;
+    }
+
+    Lock lock(this);
+    bool flushed = false;
+    while (true) {
+      if (tryDequeueSpilled(inc, job)) return job;
+      ++m_idleWorkers;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (tryDequeueStealing(id, inc, job)) {
+        --m_idleWorkers;
+        return job;
+      }
+      if (m_stopped) {
+        --m_idleWorkers;
+        throw StopSignal();
+      }
+      if (m_dropCacheTimeout <= 0 || flushed) {
+        wait(id, false);
+        --m_idleWorkers;
+      } else if (!wait(id, true, m_dropCacheTimeout)) {
+        --m_idleWorkers;
+        // since we timed out, maybe we can turn idle without holding memory
+        if (!m_jobCount) {
+          ScopedUnlock unlock(this);
+          Util::flush_thread_caches();
+          if (m_dropStack && Util::s_stackLimit) {
+            Util::flush_thread_stack();
+          }
+          DropCachePolicy::dropCache();
+          flushed = true;
+        }
+      } else {
+        --m_idleWorkers;
+      }
+    }
+  }
+
+  std::atomic<int> m_jobCount;
   std::deque<TJob> m_jobs;
   bool m_stopped;
   int m_workerCount;
   int m_dropCacheTimeout;
   bool m_dropStack;
   int m_lifoSwitchThreshold;
+
+  // work-stealing mode only
+  std::vector<std::unique_ptr<WorkStealingDeque<TJob>>> m_deques;
+  std::atomic<unsigned> m_nextDeque;
+  std::atomic<int> m_idleWorkers;
+  std::atomic<int> m_spilledJobs;
 };
 
 template<class TJob, class Policy>
 struct JobQueue<TJob,true,Policy> : JobQueue<TJob,false,Policy> {
   JobQueue(int threadCount, bool threadRoundRobin, int dropCacheTimeout,
-           bool dropStack, int lifoSwitchThreshold=INT_MAX) :
+           bool dropStack, int lifoSwitchThreshold=INT_MAX,
+           bool workStealing=false) :
     JobQueue<TJob,false,Policy>(threadCount,
                                 threadRoundRobin,
                                 dropCacheTimeout,
                                 dropStack,
-                                lifoSwitchThreshold) {
+                                lifoSwitchThreshold,
+                                workStealing) {
     pthread_cond_init(&m_cond, nullptr);
   }
   ~JobQueue() {
@@ -338,11 +481,12 @@ public:
    */
   JobQueueDispatcher(int threadCount, bool threadRoundRobin,
                      int dropCacheTimeout, bool dropStack, void *opaque,
-                     int lifoSwitchThreshold = INT_MAX)
+                     int lifoSwitchThreshold = INT_MAX,
+                     bool workStealing = false)
       : m_stopped(true), m_id(0), m_opaque(opaque),
         m_maxThreadCount(threadCount),
         m_queue(threadCount, threadRoundRobin, dropCacheTimeout, dropStack,
-                lifoSwitchThreshold) {
+                lifoSwitchThreshold, workStealing) {
     assert(threadCount >= 1);
     if (!TWorker::CountActive) {
       // If TWorker does not support counting the number of
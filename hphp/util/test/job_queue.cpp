@@ -65,4 +65,67 @@ TEST(JobQueue, Ordering) {
   }
 }
 
+TEST(JobQueue, WorkStealingOrdering) {
+  // With a single deque, work-stealing mode keeps the exact ordering.
+  {
+    JobQueue<int> job_queue(1, false, 0, false, INT_MAX, true);
+    for (int i = 0; i < 100; ++i) {
+      job_queue.enqueue(i);
+    }
+
+    EXPECT_EQ(100, job_queue.getQueuedJobs());
+
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ(i, job_queue.dequeue(0));
+    }
+  }
+
+  {
+    JobQueue<int> job_queue(1, false, 0, false, 0, true);
+    for (int i = 0; i < 100; ++i) {
+      job_queue.enqueue(i);
+    }
+
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ(100 - i - 1, job_queue.dequeue(0));
+    }
+  }
+
+  {
+    JobQueue<int> job_queue(1, false, 0, false, 50, true);
+    for (int i = 0; i < 100; ++i) {
+      job_queue.enqueue(i);
+    }
+
+    for (int i = 0; i < 50; ++i) {
+      EXPECT_EQ(100 - i - 1, job_queue.dequeue(0));
+    }
+    for (int i = 0; i < 50; ++i) {
+      EXPECT_EQ(i, job_queue.dequeue(0));
+    }
+  }
+}
+
+TEST(JobQueue, WorkStealing) {
+  // Worker 0 drains everything, stealing from the other deques and from
+  // the spill queue once the deques are full.
+  const int kJobs = 5000;
+  JobQueue<int> job_queue(4, false, 0, false, INT_MAX, true);
+  for (int i = 0; i < kJobs; ++i) {
+    job_queue.enqueue(i);
+  }
+
+  EXPECT_EQ(kJobs, job_queue.getQueuedJobs());
+
+  std::vector<bool> seen(kJobs);
+  for (int i = 0; i < kJobs; ++i) {
+    int job = job_queue.dequeue(0);
+    ASSERT_TRUE(job >= 0 && job < kJobs);
+    EXPECT_FALSE(seen[job]);
+    seen[job] = true;
+  }
+
+  EXPECT_EQ(0, job_queue.getQueuedJobs());
+}
+
 }
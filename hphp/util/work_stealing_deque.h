@@ -0,0 +1,163 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef incl_HPHP_UTIL_WORK_STEALING_DEQUE_H_
+#define incl_HPHP_UTIL_WORK_STEALING_DEQUE_H_
+
+#include <atomic>
+#include <memory>
+#include <sched.h>
+#include <stdint.h>
+
+#include "hphp/util/assertions.h"
+#include "hphp/util/cycles.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Bounded multi-producer multi-consumer deque used by JobQueue's
+ * work-stealing mode.
+ *
+ * Jobs are pushed at the back and can be popped from either end, so the
+ * owning worker can honor JobQueue's FIFO/LIFO switch while idle workers
+ * steal from the same queue. The live range [head, tail) is a single 64-bit
+ * word that producers and consumers reserve slots from with a CAS, and each
+ * slot carries a small state word that hands the job over from the
+ * reserving producer to the reserving consumer.
+ *
+ * That state word is effectively a per-slot lock: a reservation has to
+ * wait for the thread that reserved the same slot just before it to finish
+ * its copy. The wait is normally a few cycles, but that thread may have
+ * been preempted, so after a short spin the waiter yields its CPU instead
+ * of burning it.
+ *
+ * Capacity must be a power of two. push() returns false when the deque is
+ * full; callers are expected to have a fallback.
+ */
+template<class T>
+class WorkStealingDeque {
+public:
+  explicit WorkStealingDeque(uint32_t capacity)
+      : m_mask(capacity - 1)
+      , m_slots(new Slot[capacity])
+      , m_range(0) {
+    always_assert(capacity && !(capacity & (capacity - 1)));
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  bool push(const T& val) {
+    uint64_t r = m_range.load(std::memory_order_relaxed);
+    uint32_t t;
+    do {
+      if (tail(r) - head(r) > m_mask) return false;
+      t = tail(r);
+    } while (!m_range.compare_exchange_weak(r, pack(head(r), t + 1)));
+    Slot& s = m_slots[t & m_mask];
+    s.acquire(kEmpty, kWriting);
+    s.value = val;
+    s.state.store(kFull, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Take the oldest job. Used by the owner in FIFO mode and by thieves.
+   */
+  bool popFront(T& out) {
+    uint64_t r = m_range.load(std::memory_order_relaxed);
+    uint32_t h;
+    do {
+      if (head(r) == tail(r)) return false;
+      h = head(r);
+    } while (!m_range.compare_exchange_weak(r, pack(h + 1, tail(r))));
+    take(m_slots[h & m_mask], out);
+    return true;
+  }
+
+  /*
+   * Take the newest job. Used when the queue is past its LIFO threshold.
+   */
+  bool popBack(T& out) {
+    uint64_t r = m_range.load(std::memory_order_relaxed);
+    uint32_t t;
+    do {
+      if (head(r) == tail(r)) return false;
+      t = tail(r) - 1;
+    } while (!m_range.compare_exchange_weak(r, pack(head(r), t)));
+    take(m_slots[t & m_mask], out);
+    return true;
+  }
+
+  bool empty() const {
+    uint64_t r = m_range.load(std::memory_order_acquire);
+    return head(r) == tail(r);
+  }
+
+  uint32_t size() const {
+    uint64_t r = m_range.load(std::memory_order_acquire);
+    return tail(r) - head(r);
+  }
+
+private:
+  enum : int { kEmpty, kWriting, kFull, kReading };
+  static const int kSpinsBeforeYield = 100;
+
+  struct Slot {
+    Slot() : state(kEmpty) {}
+
+    void acquire(int from, int to) {
+      int expected = from;
+      for (int spins = 0;
+           !state.compare_exchange_weak(expected, to,
+                                        std::memory_order_acquire);
+           ++spins) {
+        expected = from;
+        if (spins < kSpinsBeforeYield) {
+          cpuRelax();
+        } else {
+          sched_yield();
+        }
+      }
+    }
+
+    std::atomic<int> state;
+    T value;
+  };
+
+  void take(Slot& s, T& out) {
+    s.acquire(kFull, kReading);
+    out = s.value;
+    s.value = T();
+    s.state.store(kEmpty, std::memory_order_release);
+  }
+
+  static uint32_t head(uint64_t r) { return uint32_t(r >> 32); }
+  static uint32_t tail(uint64_t r) { return uint32_t(r); }
+  static uint64_t pack(uint32_t h, uint32_t t) {
+    return (uint64_t(h) << 32) | t;
+  }
+
+  const uint32_t m_mask;
+  std::unique_ptr<Slot[]> m_slots;
+  std::atomic<uint64_t> m_range;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif